@@ -1,31 +1,38 @@
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <csignal>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <fstream>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "batch.h"
 #include "client.h"
+#include "corpus.h"
+#include "evaluate.h"
 #include "generator.h"
+#include "pattern_cache.h"
+#include "referee.h"
+#include "replay.h"
 #include "server.h"
 
 bool batch_mode = false;
+// How Execute() passes the result of an operation to the client: the changed blocks directly (kObserve), the map as
+// text through PrintMap() and ReadMap() just like the judger on OJ does (kText), or only the changed blocks as text
+// through PrintChanges() and ReadChanges() (kDelta). All three lead to the same game.
+Protocol protocol = Protocol::kObserve;
 
 /**
- * @brief The implementation of function Execute
- * @details Use it only when trying advanced task. Do NOT modify it before discussing with TA.
+ * Pass the result of the last operation to the client by protocol, or end the game.
  */
-void Execute(int row, int column, int type) {
+void PassResult() {
   std::string str;
-  if (type == 0) {
-    VisitBlock(row, column);
-  } else if (type == 1) {
-    MarkMine(row, column);
-  } else if (type == 2) {
-    AutoExplore(row, column);
-  } else {
-    std::cerr << "Invalid type = " << type << std::endl;
-    exit(-1);
-  }
   if (game_state != 0) {
     // PrintMap(); // this line may help you debug
     ExitGame();
@@ -33,24 +40,70 @@ void Execute(int row, int column, int type) {
       return;
     }
   }
+  if (protocol == Protocol::kObserve) {
+    Observe(GetChanges());
+    return;
+  }
   std::ostringstream oss;
   std::streambuf *old_output_buffer = std::cout.rdbuf();
   std::cout.rdbuf(oss.rdbuf());
   // Here, we redirect the output stream to the string stream.
   // By this way the output of PrintMap() would be stored in the string.
   // If you do not understand, you can try to compare it with freopen, which redirect the output stream to a file.
-  PrintMap();
+  if (protocol == Protocol::kDelta) {
+    PrintChanges();
+  } else {
+    PrintMap();
+  }
   std::cout.rdbuf(old_output_buffer);  // Restore the output buffer
   str = oss.str();                     // Read the output
   std::istringstream iss(str);         // Redirect the input to the string, which stores the output recently
   std::streambuf *old_input_buffer = std::cin.rdbuf();
   std::cin.rdbuf(iss.rdbuf());
-  ReadMap();
+  if (protocol == Protocol::kDelta) {
+    ReadChanges();
+  } else {
+    ReadMap();
+  }
   std::cin.rdbuf(old_input_buffer);
   // PrintMap(); // These two lines may help you debug
   // std::cout << std::endl;
 }
 
+/**
+ * @brief The implementation of function Execute
+ * @details Use it only when trying advanced task. Do NOT modify it before discussing with TA.
+ */
+void Execute(int row, int column, int type) {
+  if (type == 0) {
+    VisitBlock(row, column);
+  } else if (type == 1) {
+    MarkMine(row, column);
+  } else if (type == 2) {
+    AutoExplore(row, column);
+  } else {
+    std::cerr << "Invalid type = " << type << std::endl;
+    exit(-1);
+  }
+  PassResult();
+}
+
+/**
+ * @brief The implementation of function ExecuteBatch
+ * @details The operations are executed by the server as one (see ExecuteOperations()), so the map is passed to the
+ * client once for all of them.
+ */
+void ExecuteBatch(const std::vector<Operation> &ops) {
+  for (const Operation &op : ops) {
+    if (op.type < 0 || op.type > 2) {
+      std::cerr << "Invalid type = " << op.type << std::endl;
+      exit(-1);
+    }
+  }
+  ExecuteOperations(ops);
+  PassResult();
+}
+
 /**
  * Running a single test.
  * You should manually input the data.
@@ -66,40 +119,381 @@ void TestSingle() {
   }
 }
 
+/**
+ * Print the results of a batch: with per_game a line "index game_state visit_count marked_count" for every game, then
+ * the summary.
+ */
+void PrintResults(const std::vector<GameResult> &results, int first_game, bool per_game) {
+  if (per_game) {
+    for (size_t i = 0; i < results.size(); ++i) {
+      std::cout << first_game + i << " " << results[i].game_state << " " << results[i].visit_count << " "
+                << results[i].marked_count << std::endl;
+    }
+  }
+  BatchSummary summary = Summarize(results);
+  double games = summary.games > 0 ? summary.games : 1;
+  std::cout << "games " << summary.games << std::endl;
+  std::cout << "win_rate " << summary.wins / games << std::endl;
+  std::cout << "avg_visit_count " << summary.visit_count / games << std::endl;
+  std::cout << "avg_marked_count " << summary.marked_count / games << std::endl;
+}
+
+/**
+ * Print the use of the pattern cache shared by the clients of a batch (solver.h), if any:
+ *   pattern_cache hits H misses M hit_rate R evictions E
+ */
+void PrintPatternCache(const ClientNS::PatternCache *cache) {
+  if (cache == nullptr) {
+    return;
+  }
+  std::cout << "pattern_cache hits " << cache->Hits() << " misses " << cache->Misses() << " hit_rate "
+            << cache->HitRate() << " evictions " << cache->Evictions() << std::endl;
+}
+
 /**
  * Running test many times (to simulate real tests).
- * You just need to input rows, columns, mine_count and random seed.
+ * You just need to input rows, columns, mine_count, random seed and min_dist, just like testcases/advanced/batch*.in.
+ * If corpus_path is not empty, the games are played on the boards of that corpus (see corpus.h) instead, and nothing
+ * is read; config.games < 0 plays all of them from config.first_game.
  *
- * @note If you want to use this function, you should modify the program a little bit:
- *   - Modify your server so that it supports dealing with multiple maps in a single run;
- *   - Remove the line "exit(0)" in function ExitGame(). (Or your program may exit immediately after running a single test).
- * The special judger on OJ will be a special version of server.h.
- * We'll do some optimizations to it so that it will be faster.
+ * The games are played by the batch evaluator in batch.h, each with its own server and client, on a thread pool. The
+ * result of every game only depends on the input and the index of the game, not on the number of threads. If
+ * replay_path is not empty, every game is recorded to a replay log there (see replay.h and `replay`).
  */
-void TestBatch() {
-  batch_mode = true;
-  int rows, columns, mine_count, min_dist;
-  uint64_t seed;
-  std::cin >> rows >> columns >> mine_count >> seed >> min_dist;
-  InitSeed(seed);
-  for (int i = 0; i < 50; ++i) {
-    std::string str;
-    std::ostringstream oss;
-    std::streambuf *old_output_buffer = std::cout.rdbuf();
-    std::cout.rdbuf(oss.rdbuf());
-    GenerateMap(rows, columns, mine_count, min_dist);
-    std::cout.rdbuf(old_output_buffer);  // Restore the output buffer
-    str = oss.str();                     // Read the output
-    std::istringstream iss(str);         // Redirect the input to the string, which stores the output recently
-    std::streambuf *old_input_buffer = std::cin.rdbuf();
-    std::cin.rdbuf(iss.rdbuf());
-    TestSingle();
-    std::cin.rdbuf(old_input_buffer);
-    game_state = 0;
+void TestBatch(BatchConfig config, bool per_game, const std::string &corpus_path, const std::string &replay_path,
+               [[maybe_unused]] const std::string &metrics_csv, [[maybe_unused]] const std::string &metrics_json) {
+  CorpusReader corpus;
+  if (corpus_path.empty()) {
+    std::cin >> config.rows >> config.columns >> config.mine_count >> config.seed >> config.min_dist;
+  } else {
+    std::string error;
+    if (!corpus.Open(corpus_path, &error)) {
+      std::cerr << "Cannot read the corpus: " << error << std::endl;
+      exit(-1);
+    }
+    int available = std::max(corpus.Size() - config.first_game, 0);
+    config.games = config.games < 0 ? available : std::min(config.games, available);
+    for (int i = 0; i < config.games; ++i) {
+      CorpusBoard board = corpus.Board(config.first_game + i);
+      config.rows = std::max(config.rows, board.rows);
+      config.columns = std::max(config.columns, board.columns);
+    }
+    config.corpus = &corpus;
+  }
+  if (config.bitboard && (config.rows > BitboardGame::kMaxSize || config.columns > BitboardGame::kMaxSize)) {
+    std::cerr << "The bitboard backend supports at most " << BitboardGame::kMaxSize << " rows and columns" << std::endl;
+    exit(-1);
+  }
+  ReplayWriter replay;
+  if (!replay_path.empty()) {
+    if (!replay.Open(replay_path)) {
+      std::cerr << "Cannot write " << replay_path << std::endl;
+      exit(-1);
+    }
+    config.replay = &replay;
+  }
+  std::vector<GameResult> results = RunBatch(config);
+  if (!replay_path.empty() && !replay.Close()) {
+    std::cerr << "Cannot write " << replay_path << std::endl;
+    exit(-1);
+  }
+  PrintResults(results, config.first_game, per_game);
+  PrintPatternCache(config.solver.cache);
+#ifdef MINESWEEPER_METRICS
+  if (!metrics_csv.empty()) {
+    std::ofstream out(metrics_csv);
+    WriteMetricsCsv(out, results, config.first_game);
+  }
+  if (!metrics_json.empty()) {
+    std::ofstream out(metrics_json);
+    WriteMetricsJson(out, results);
   }
+#endif
 }
 
-int main() {
-  TestSingle();
-  // TestBatch();
+/**
+ * Play the games of a batch on a referee process (referee.h): a `server --referee` started from server_path, or the
+ * one listening on socket_path. Prints the same lines as TestBatch(), then the throughput and the latency of the
+ * requests:
+ *   games_per_second G
+ *   requests R operations O
+ *   latency_us p50 p90 p99 max
+ */
+void TestReferee(BatchConfig config, bool per_game, const std::string &server_path, const std::string &socket_path,
+                 int in_flight) {
+  std::cin >> config.rows >> config.columns >> config.mine_count >> config.seed >> config.min_dist;
+  // A referee that exits early is reported by PlayReferee() instead of killing the client.
+  signal(SIGPIPE, SIG_IGN);
+  int to_referee;
+  int from_referee;
+  pid_t pid = -1;
+  if (socket_path.empty()) {
+    pid = SpawnReferee(server_path, to_referee, from_referee);
+    if (pid < 0) {
+      std::cerr << "Cannot start " << server_path << std::endl;
+      exit(-1);
+    }
+  } else {
+    to_referee = from_referee = ConnectReferee(socket_path);
+    if (to_referee < 0) {
+      std::cerr << "Cannot connect to " << socket_path << std::endl;
+      exit(-1);
+    }
+  }
+  std::vector<GameResult> results;
+  RefereeStats stats;
+  std::string error;
+  bool ok = PlayReferee(config, from_referee, to_referee, in_flight, results, stats, &error);
+  close(to_referee);
+  if (from_referee != to_referee) {
+    close(from_referee);
+  }
+  if (pid > 0) {
+    waitpid(pid, nullptr, 0);
+  }
+  if (!ok) {
+    std::cerr << error << std::endl;
+    exit(-1);
+  }
+  PrintResults(results, config.first_game, per_game);
+  std::cout << "games_per_second " << results.size() / std::max(stats.seconds, 1e-9) << std::endl;
+  std::cout << "requests " << stats.requests << " operations " << stats.operations << std::endl;
+  std::cout << "latency_us " << Percentile(stats.latencies, 0.5) << " " << Percentile(stats.latencies, 0.9) << " "
+            << Percentile(stats.latencies, 0.99) << " " << Percentile(stats.latencies, 1) << std::endl;
+  PrintPatternCache(config.solver.cache);
+}
+
+/**
+ * Compare two clients on the same games of a batch until the paired sequential test of evaluate.h stops, and print
+ * the number of games, the decision, the win rates with their Wilson and Clopper-Pearson intervals and the throughput
+ * of both clients. The parameters of the batch are read like in TestBatch(), unless config.batch.corpus is set.
+ */
+void TestEvaluate(EvaluationConfig config, const std::string &corpus_path) {
+  if (!(config.alpha > 0 && config.alpha < 1 && config.beta > 0 && config.beta < 1 && config.delta > 0 &&
+        config.delta < 0.5)) {
+    std::cerr << "Expected 0 < alpha, beta < 1 and 0 < delta < 0.5" << std::endl;
+    exit(-1);
+  }
+  CorpusReader corpus;
+  if (corpus_path.empty()) {
+    std::cin >> config.batch.rows >> config.batch.columns >> config.batch.mine_count >> config.batch.seed >>
+        config.batch.min_dist;
+  } else {
+    std::string error;
+    if (!corpus.Open(corpus_path, &error)) {
+      std::cerr << "Cannot read the corpus: " << error << std::endl;
+      exit(-1);
+    }
+    config.max_games = std::min(config.max_games, std::max(corpus.Size() - config.batch.first_game, 0));
+    config.batch.corpus = &corpus;
+  }
+  if (config.batch.bitboard && (config.batch.rows > BitboardGame::kMaxSize ||
+                                config.batch.columns > BitboardGame::kMaxSize)) {
+    std::cerr << "The bitboard backend supports at most " << BitboardGame::kMaxSize << " rows and columns" << std::endl;
+    exit(-1);
+  }
+  EvaluationResult result = Evaluate(config);
+  const char *const kReasons[] = {"sprt", "width", "max_games"};
+  const char *const kDecisions[] = {"candidate_not_better", "undecided", "candidate_better"};
+  double games = result.games > 0 ? result.games : 1;
+  double z = NormalQuantile(1 - config.alpha / 2);
+  auto print_rate = [&](const std::string &name, long long wins, double seconds) {
+    Interval wilson = WilsonInterval(wins, result.games, z);
+    Interval exact = ClopperPearsonInterval(wins, result.games, config.alpha);
+    std::cout << name << "_win_rate " << wins / games << std::endl;
+    std::cout << name << "_wilson " << wilson.low << " " << wilson.high << std::endl;
+    std::cout << name << "_clopper_pearson " << exact.low << " " << exact.high << std::endl;
+    std::cout << name << "_games_per_second " << (seconds > 0 ? result.games_run / seconds : 0) << std::endl;
+  };
+  std::cout << "games " << result.games << std::endl;
+  std::cout << "games_run " << result.games_run << std::endl;
+  std::cout << "stopped_by " << kReasons[static_cast<int>(result.reason)] << std::endl;
+  std::cout << "decision " << kDecisions[result.decision + 1] << std::endl;
+  std::cout << "llr " << result.llr << " " << result.llr_lower << " " << result.llr_upper << std::endl;
+  std::cout << "discordant " << result.candidate_only << " " << result.baseline_only << std::endl;
+  print_rate("baseline", result.baseline_wins, result.baseline_seconds);
+  print_rate("candidate", result.candidate_wins, result.candidate_seconds);
+}
+
+/**
+ * Usage: client [--text | --delta-protocol] [--batch [batch options]]
+ *   --text           pass the map to the client as text (the protocol used on OJ)
+ *   --delta-protocol pass only the changed blocks to the client as text (PrintChanges() and ReadChanges())
+ *   --batch          run TestBatch() instead of TestSingle()
+ *   --evaluate       run TestEvaluate(): compare two clients, the baseline and the candidate, on the batch read like
+ *                    --batch
+ * Batch options:
+ *   --games N        the number of games (50 by default, all the boards of a corpus with --corpus)
+ *   --threads T      the number of threads (one per hardware thread by default)
+ *   --per-game       also print "index game_state visit_count marked_count" for every game
+ *   --bitboard       use the bitboard server backend (bitboard.h)
+ *   --fast-gen       generate the maps with BoardGenerator (generator.h), not the judger's GenerateMap()
+ *   --philox         generate map i from its own counter-based generator BoardRandom(seed, i) (philox.h), instead of
+ *                    one mt19937_64 stream for the whole batch
+ *   --first-game I   start at game I of the run (with --per-game, lines keep the index of the game in the run)
+ *   --corpus FILE    play the boards of a corpus file (see corpus.h and `corpus`) instead of reading the parameters
+ *   --record FILE    record every game to the replay log FILE (see replay.h), to check or replay with `replay`
+ *   --no-solver      guess at random instead of using the frontier solver (solver.h)
+ *   --no-gauss       skip the Gaussian elimination tier (gauss.h) between the simple rules and the solver
+ *   --node-budget B  the search node budget of the frontier solver per decision
+ *   --solver-threads S  enumerate large frontier components on S threads (same results as 1, the default)
+ *   --samples N      estimate the frontier components the node budget cuts short from up to N importance samples
+ *                    per decision (solver.h), instead of their partial enumeration
+ *   --sample-ms T    also stop sampling after T milliseconds per decision (the results then depend on the speed)
+ *   --pattern-cache SLOTS  share the counts of small frontier components between all the clients in a cache of
+ *                    SLOTS entries (pattern_cache.h), and print its hit rate; the results only change if the node
+ *                    budget binds
+ *   --referee SERVER     play the games on a referee process started as `SERVER --referee` (see referee.h), with
+ *                        the same results
+ *   --referee-socket P   play the games on the referee listening on the Unix domain socket P (`server --referee
+ *                        --socket P`)
+ *   --in-flight N        the games a referee plays at a time (16 by default)
+ *   --metrics-csv FILE   write the metrics of every game (metrics.h) to FILE as CSV
+ *   --metrics-json FILE  write the metrics of the batch summed over the games to FILE as JSON
+ * The metrics options need a build with -DMINESWEEPER_METRICS=ON.
+ * Evaluation options (with --evaluate; --games is the maximum number of games, 200000 by default):
+ *   --baseline       the solver options after this one only apply to the baseline (until --candidate)
+ *   --candidate      the solver options after this one only apply to the candidate (until --baseline)
+ *   --alpha A        the false positive rate of the SPRT, and 1 - the confidence of the intervals (0.05)
+ *   --beta B         the false negative rate of the SPRT (0.05)
+ *   --delta D        the SPRT tests whether the candidate wins 0.5 - D or 0.5 + D of the discordant games (0.1)
+ *   --width W        also stop once both Wilson intervals are at most W wide
+ */
+int main(int argc, char *argv[]) {
+  bool batch = false;
+  bool per_game = false;
+  int games = -1;
+  std::string corpus_path;
+  std::string replay_path;
+  std::string metrics_csv;
+  std::string metrics_json;
+  std::string referee_path;
+  std::string referee_socket;
+  int in_flight = 16;
+  size_t pattern_slots = 0;
+  bool evaluate = false;
+  EvaluationConfig evaluation;
+  BatchConfig config;
+  // The solver options being parsed: the shared ones of config, or after --baseline or --candidate the ones of that
+  // client only.
+  ClientNS::SolverOptions *solver = &config.solver;
+  ClientNS::SolverOptions baseline_solver;
+  bool split = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--text") == 0) {
+      protocol = Protocol::kText;
+    } else if (std::strcmp(argv[i], "--delta-protocol") == 0) {
+      protocol = Protocol::kDelta;
+    } else if (std::strcmp(argv[i], "--batch") == 0) {
+      batch = true;
+    } else if (std::strcmp(argv[i], "--games") == 0 && i + 1 < argc) {
+      games = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      config.threads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--per-game") == 0) {
+      per_game = true;
+    } else if (std::strcmp(argv[i], "--bitboard") == 0) {
+      config.bitboard = true;
+    } else if (std::strcmp(argv[i], "--fast-gen") == 0) {
+      config.fast_generator = true;
+    } else if (std::strcmp(argv[i], "--philox") == 0) {
+      config.counter_rng = true;
+    } else if (std::strcmp(argv[i], "--first-game") == 0 && i + 1 < argc) {
+      config.first_game = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+      corpus_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--no-solver") == 0) {
+      solver->enabled = false;
+    } else if (std::strcmp(argv[i], "--no-gauss") == 0) {
+      solver->gaussian = false;
+    } else if (std::strcmp(argv[i], "--node-budget") == 0 && i + 1 < argc) {
+      solver->node_budget = std::atoll(argv[++i]);
+    } else if (std::strcmp(argv[i], "--solver-threads") == 0 && i + 1 < argc) {
+      solver->threads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      solver->sample_budget = std::atoll(argv[++i]);
+    } else if (std::strcmp(argv[i], "--sample-ms") == 0 && i + 1 < argc) {
+      solver->sample_seconds = std::atof(argv[++i]) / 1000;
+    } else if (std::strcmp(argv[i], "--pattern-cache") == 0 && i + 1 < argc) {
+      pattern_slots = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--evaluate") == 0) {
+      evaluate = true;
+    } else if (std::strcmp(argv[i], "--baseline") == 0 || std::strcmp(argv[i], "--candidate") == 0) {
+      if (!split) {
+        baseline_solver = evaluation.candidate = config.solver;
+        split = true;
+      }
+      solver = argv[i][2] == 'b' ? &baseline_solver : &evaluation.candidate;
+    } else if (std::strcmp(argv[i], "--alpha") == 0 && i + 1 < argc) {
+      evaluation.alpha = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--beta") == 0 && i + 1 < argc) {
+      evaluation.beta = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--delta") == 0 && i + 1 < argc) {
+      evaluation.delta = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+      evaluation.width = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--referee") == 0 && i + 1 < argc) {
+      referee_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--referee-socket") == 0 && i + 1 < argc) {
+      referee_socket = argv[++i];
+    } else if (std::strcmp(argv[i], "--in-flight") == 0 && i + 1 < argc) {
+      in_flight = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--metrics-csv") == 0 && i + 1 < argc) {
+      metrics_csv = argv[++i];
+    } else if (std::strcmp(argv[i], "--metrics-json") == 0 && i + 1 < argc) {
+      metrics_json = argv[++i];
+    } else {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+#ifndef MINESWEEPER_METRICS
+  if (!metrics_csv.empty() || !metrics_json.empty()) {
+    std::cerr << "The metrics options need a build with -DMINESWEEPER_METRICS=ON" << std::endl;
+    return 1;
+  }
+#endif
+  if (split) {
+    config.solver = baseline_solver;
+  } else {
+    evaluation.candidate = config.solver;
+  }
+  std::unique_ptr<ClientNS::PatternCache> pattern_cache;
+  if (pattern_slots > 0) {
+    // One cache for every client, the baseline and the candidate alike: the counts of a pattern do not depend on them.
+    pattern_cache.reset(new ClientNS::PatternCache(pattern_slots));
+    config.solver.cache = evaluation.candidate.cache = pattern_cache.get();
+  }
+  if (!replay_path.empty() && (evaluate || !batch || !referee_path.empty() || !referee_socket.empty())) {
+    std::cerr << "--record only records the games of --batch played by the client itself" << std::endl;
+    return 1;
+  }
+  if (evaluate) {
+    config.protocol = protocol;
+    evaluation.batch = config;
+    if (games >= 0) {
+      evaluation.max_games = games;
+    }
+    TestEvaluate(evaluation, corpus_path);
+  } else if (batch) {
+    config.protocol = protocol;
+    if (games >= 0) {
+      config.games = games;
+    } else if (!corpus_path.empty()) {
+      config.games = -1;  // All the boards
+    }
+    if (!referee_path.empty() || !referee_socket.empty()) {
+      if (!corpus_path.empty()) {
+        std::cerr << "A referee generates its maps, --corpus cannot be used with it" << std::endl;
+        return 1;
+      }
+      TestReferee(config, per_game, referee_path, referee_socket, in_flight);
+    } else {
+      TestBatch(config, per_game, corpus_path, replay_path, metrics_csv, metrics_json);
+    }
+  } else {
+    TestSingle();
+  }
 }
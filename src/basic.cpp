@@ -1,14 +1,154 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 
+#include "fast_io.h"
+#include "referee.h"
 #include "server.h"
+#include "session.h"
+
+// referee.h plays the clients of its batch itself, the global client of client.h is never used.
+void Execute(int row, int column, int type) {
+  std::cerr << "Unexpected global Execute(" << row << ", " << column << ", " << type << ")" << std::endl;
+  exit(-1);
+}
+
+void ExecuteBatch(const std::vector<Operation> &ops) {
+  std::cerr << "Unexpected global ExecuteBatch() of " << ops.size() << " operations" << std::endl;
+  exit(-1);
+}
+
+/**
+ * The same game as main() without --fast, with the same output byte for byte, but the input is parsed by FastReader
+ * and the output of every operation (the map, or its changes if delta, and at the end the result) is rendered into one
+ * buffer and written with a single write(2), instead of one stream operation per block and a flush per row.
+ */
+int RunFast(bool delta) {
+  FastReader in;
+  FastWriter out;
+  if (!in.ReadInt(rows) || !in.ReadInt(columns)) {
+    return 1;
+  }
+  std::vector<uint64_t> mines((static_cast<size_t>(rows) * columns + 63) / 64, 0);
+  for (size_t block = 0; block < static_cast<size_t>(rows) * columns; ++block) {
+    char ch;
+    if (!in.ReadChar(ch)) {
+      return 1;
+    }
+    if (ch == 'X') {
+      mines[block >> 6] |= 1ULL << (block & 63);
+    }
+  }
+  game = MineSweeperGame(rows, columns);
+  game.InitMap(mines.data());
+  total_mines = game.getTotalMines();
+  game_state = game.getGameState();
+  if (delta) {
+    FormatChanges(out.Buffer(), game.getChanges(), game_state);
+  } else {
+    game.RenderMap(out.Buffer(), game_state);
+  }
+  out.Flush();
+  int pos_x, pos_y, type;
+  while (in.ReadInt(pos_x) && in.ReadInt(pos_y) && in.ReadInt(type)) {
+    if (type == 0) {
+      VisitBlock(pos_x, pos_y);
+    } else if (type == 1) {
+      MarkMine(pos_x, pos_y);
+    } else if (type == 2) {
+      AutoExplore(pos_x, pos_y);
+    }
+    if (delta) {
+      FormatChanges(out.Buffer(), game.getChanges(), game_state);
+    } else {
+      game.RenderMap(out.Buffer(), game_state);
+    }
+    if (game_state != 0) {
+      // The output of ExitGame().
+      out.Write(game_state == 1 ? "YOU WIN!\n" : "GAME OVER!\n");
+      out.WriteInt(game.getVisitCount());
+      out.Write(" ");
+      out.WriteInt(game.getMarkedCount());
+      out.Write("\n");
+      out.Flush();
+      return 0;
+    }
+    out.Flush();
+  }
+  return 0;
+}
 
 /**
  * This is the main function of the game. You don't need to modify it.
  * Just finish server.h and run!
+ *
+ * Usage: server [--fast] [--delta] | --referee [--socket PATH] | --sessions N [--session-size ROWS COLUMNS]
+ *   --fast         read and write with the buffered I/O of fast_io.h (see RunFast()), with exactly the same output
+ *   --delta        print only the blocks changed by every operation with PrintChanges() instead of the whole map; the
+ *                  output starts with the empty delta "0 0" of the initial map
+ *   --referee      play the games of a batch for a `client --referee` over stdin and stdout (see referee.h)
+ *   --socket PATH  with --referee, serve the clients connecting to a Unix domain socket at PATH instead
+ *   --sessions N   host up to N games at a time over stdin and stdout, every operation naming its session (see
+ *                  session.h); the games end without ending the server
+ *   --session-size ROWS COLUMNS  with --sessions, the largest map of a session (30 * 30 by default)
  */
-int main() {
+int main(int argc, char *argv[]) {
+  bool fast = false;
+  bool delta = false;
+  bool referee = false;
+  std::string socket_path;
+  int sessions = 0;
+  int session_rows = 30;
+  int session_columns = 30;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--fast") == 0) {
+      fast = true;
+    } else if (std::strcmp(argv[i], "--delta") == 0) {
+      delta = true;
+    } else if (std::strcmp(argv[i], "--referee") == 0) {
+      referee = true;
+    } else if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+      sessions = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--session-size") == 0 && i + 2 < argc) {
+      session_rows = std::atoi(argv[++i]);
+      session_columns = std::atoi(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  if (sessions != 0) {
+    if (sessions < 0 || sessions > SessionTable::kMaxCapacity || session_rows < 1 || session_columns < 1) {
+      std::cerr << "--sessions takes 1 to " << SessionTable::kMaxCapacity << " sessions of at least 1 * 1 blocks"
+                << std::endl;
+      return 1;
+    }
+    return ServeSessions(0, 1, sessions, session_rows, session_columns) ? 0 : 1;
+  }
+  if (referee && !socket_path.empty()) {
+    if (!ListenReferee(socket_path)) {
+      std::cerr << "Cannot listen on " << socket_path << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+  if (referee) {
+    return ServeReferee(0, 1) ? 0 : 1;
+  }
+  if (fast) {
+    return RunFast(delta);
+  }
   InitMap();
-  PrintMap();
+  if (delta) {
+    PrintChanges();
+  } else {
+    PrintMap();
+  }
   while (true) {
     int pos_x, pos_y, type;
     // Read the coordinate and operation type. 0 for VisitBlock(x, y), 1 for MarkMine(x, y) and 2 for AutoExplore(x, y)
@@ -20,7 +160,11 @@ int main() {
     } else if (type == 2) {
       AutoExplore(pos_x, pos_y);
     }
-    PrintMap();
+    if (delta) {
+      PrintChanges();
+    } else {
+      PrintMap();
+    }
     if (game_state != 0) {
       ExitGame();
     }
@@ -0,0 +1,1483 @@
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "bitboard.h"
+#include "client.h"
+#include "corpus.h"
+#include "generator.h"
+#include "neighbours.h"
+#include "pattern_cache.h"
+#include "referee.h"
+#include "server.h"
+#include "session.h"
+
+void Execute(int row, int column, int type) {
+  // The benchmarks drive their own games, the global client is never used.
+  std::cerr << "Unexpected global Execute(" << row << ", " << column << ", " << type << ")" << std::endl;
+  exit(-1);
+}
+
+void ExecuteBatch(const std::vector<Operation> &ops) {
+  std::cerr << "Unexpected global ExecuteBatch() of " << ops.size() << " operations" << std::endl;
+  exit(-1);
+}
+
+// Print the results as JSON lines instead of text, see Report().
+bool json_output = false;
+
+/**
+ * Print the result of a benchmark as a line "name value...", or with --json as a JSON object
+ *   {"name": "name", "key": value, ...}
+ * on a line of its own, so that the results of two commits can be compared by a script.
+ */
+void Report(const std::string &name, const std::vector<std::pair<std::string, double>> &values) {
+  // Counts are printed as integers, not in the default 6 significant digits.
+  auto print = [](double value) {
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+      std::cout << static_cast<long long>(value);
+    } else {
+      std::cout << value;
+    }
+  };
+  if (!json_output) {
+    std::cout << name;
+    for (const auto &value : values) {
+      std::cout << " ";
+      print(value.second);
+    }
+    std::cout << std::endl;
+    return;
+  }
+  std::cout << "{\"name\": \"" << name << "\"";
+  for (const auto &value : values) {
+    std::cout << ", \"" << value.first << "\": ";
+    print(value.second);
+  }
+  std::cout << "}" << std::endl;
+}
+
+/**
+ * Run body repeatedly for at least min_seconds and report the average time of one call of body as
+ *   name iterations ns_per_op
+ */
+template <class Body>
+void Run(const std::string &name, Body body, double min_seconds = 0.3) {
+  using Clock = std::chrono::steady_clock;
+  long long iterations = 0;
+  long long batch = 1;
+  double elapsed = 0;
+  while (elapsed < min_seconds) {
+    auto start = Clock::now();
+    for (long long i = 0; i < batch; ++i) {
+      body();
+    }
+    elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+    iterations += batch;
+    batch *= 2;
+  }
+  Report(name, {{"iterations", iterations}, {"ns_per_op", elapsed * 1e9 / iterations}});
+}
+
+// Keep the compiler from dropping the work of a benchmark.
+volatile long long sink;
+
+/**
+ * A rows * columns map with a single mine in the last corner, so that visiting (0, 0) opens everything else at once.
+ */
+std::string OpenMapText(int rows, int columns) {
+  std::string text = std::to_string(rows) + " " + std::to_string(columns) + "\n";
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < columns; ++j) {
+      text += (i == rows - 1 && j == columns - 1) ? 'X' : '.';
+    }
+    text += '\n';
+  }
+  return text;
+}
+
+template <class Game>
+Game LoadGame(const std::string &map_text) {
+  std::istringstream input(map_text);
+  int rows, columns;
+  input >> rows >> columns;
+  Game game(rows, columns);
+  game.InitMap(input);
+  return game;
+}
+
+// The flood fill of VisitBlock on a worst-case open map, starting from a fresh copy of the game every time.
+template <class Game>
+void BenchCascade(const std::string &backend, int size) {
+  const Game fresh = LoadGame<Game>(OpenMapText(size, size));
+  std::string label = std::to_string(size) + "x" + std::to_string(size);
+  Run("cascade_" + label + "/" + backend, [&] {
+    Game game = fresh;
+    game.Execute(0, 0, 0);
+    sink = game.getVisitCount();
+  });
+}
+
+/**
+ * AutoExplore() on a block next to the only mine, marked, of a worst-case open map: it visits a block with mine count
+ * 0, which opens everything else.
+ */
+template <class Game>
+void BenchAutoExplore(const std::string &backend, int size) {
+  Game fresh = LoadGame<Game>(OpenMapText(size, size));
+  fresh.Execute(size - 1, size - 1, 1);
+  fresh.Execute(size - 2, size - 2, 0);
+  std::string label = std::to_string(size) + "x" + std::to_string(size);
+  Run("autoexplore_" + label + "/" + backend, [&] {
+    Game game = fresh;
+    game.Execute(size - 2, size - 2, 2);
+    sink = game.getVisitCount();
+  });
+}
+
+/**
+ * The mine count of every block of a rows * columns map with 20% mines: scattered to the 8 neighbours of every mine
+ * with bounds checks (how InitMap() counted before neighbours.h), and by every kernel of CountNeighbours() the CPU
+ * supports, which must give the same counts.
+ */
+void BenchNeighbours(int rows, int columns) {
+  std::mt19937 random(rows * 31 + columns);
+  std::vector<unsigned char> plane(static_cast<size_t>(rows) * columns);
+  for (unsigned char &block : plane) {
+    block = random() % 5 == 0;
+  }
+  std::vector<unsigned char> expected(plane.size());
+  auto scatter = [&](std::vector<unsigned char> &counts) {
+    std::fill(counts.begin(), counts.end(), 0);
+    for (int r = 0; r < rows; ++r) {
+      for (int c = 0; c < columns; ++c) {
+        if (!plane[static_cast<size_t>(r) * columns + c]) {
+          continue;
+        }
+        for (int k = 0; k < 8; ++k) {
+          int x = r + kNeighbourRow[k];
+          int y = c + kNeighbourColumn[k];
+          if (x >= 0 && x < rows && y >= 0 && y < columns) {
+            ++counts[static_cast<size_t>(x) * columns + y];
+          }
+        }
+      }
+    }
+  };
+  scatter(expected);
+  std::string label = std::to_string(rows) + "x" + std::to_string(columns);
+  std::vector<unsigned char> counts(plane.size());
+  Run("neighbours_" + label + "/scatter", [&] {
+    scatter(counts);
+    sink = counts[0];
+  });
+  const std::pair<NeighbourKernel, const char *> kernels[] = {
+      {NeighbourKernel::kScalar, "scalar"}, {NeighbourKernel::kSse2, "sse2"}, {NeighbourKernel::kAvx2, "avx2"}};
+  for (const auto &kernel : kernels) {
+    if (!NeighbourKernelSupported(kernel.first)) {
+      continue;
+    }
+    CountNeighbours(plane.data(), rows, columns, counts.data(), kernel.first);
+    if (counts != expected) {
+      std::cerr << "The " << kernel.second << " kernel miscounts a " << label << " map" << std::endl;
+      exit(-1);
+    }
+    Run("neighbours_" + label + "/" + kernel.second, [&] {
+      CountNeighbours(plane.data(), rows, columns, counts.data(), kernel.first);
+      sink = counts[0];
+    });
+  }
+}
+
+// InitMap() parsing the text of a map of config.
+template <class Game>
+void BenchParse(const std::string &backend, const BatchConfig &config, const std::string &label) {
+  InitSeed(config.seed);
+  std::string text = GenerateMapText(config);
+  Run("parse_" + label + "/" + backend, [&] {
+    Game game = LoadGame<Game>(text);
+    sink = game.getTotalMines();
+  });
+}
+
+// PrintMap() of a game of config after its first step, into a reused buffer.
+template <class Game>
+void BenchPrint(const std::string &backend, const BatchConfig &config, const std::string &label) {
+  InitSeed(config.seed);
+  std::istringstream input(GenerateMapText(config));
+  int rows, columns, first_row, first_column;
+  input >> rows >> columns;
+  Game game(rows, columns);
+  game.InitMap(input);
+  input >> first_row >> first_column;
+  game.Execute(first_row, first_column, 0);
+  std::ostringstream out;
+  Run("print_" + label + "/" + backend, [&] {
+    out.seekp(0);
+    game.PrintMap(out);
+    sink = out.tellp();
+  });
+  if constexpr (std::is_same<Game, MineSweeperGame>::value) {
+    // The same map rendered into a reused buffer, as `server --fast` does.
+    std::string buffer;
+    Run("print_" + label + "/" + backend + "_render", [&] {
+      buffer.clear();
+      game.RenderMap(buffer, 0);
+      sink = buffer.size();
+    });
+  }
+}
+
+// Full games on maps of a batch*.in configuration, the result of every operation passed to the client by protocol.
+template <class Game>
+void BenchGames(const std::string &backend, const BatchConfig &config, const std::string &label,
+                Protocol protocol = Protocol::kObserve) {
+  const int kMaps = 64;
+  std::vector<std::string> maps;
+  InitSeed(config.seed);
+  for (int i = 0; i < kMaps; ++i) {
+    maps.push_back(GenerateMapText(config));
+  }
+  int next = 0;
+  Run("game_" + label + "/" + backend, [&] {
+    GameResult result = PlayGame<Game>(maps[next], ClientSeed(config.seed, next), protocol);
+    sink = result.visit_count;
+    next = (next + 1) % kMaps;
+  });
+}
+
+/**
+ * Play games 0 to games - 1 of config (the maps of the mt19937_64 stream of config.seed) with the default client, and
+ * call on_position(g, game, client, view) at every position: after an operation that does not end game g, once the
+ * client has observed its changes and before it decides the next operation. view is the map the client sees (-1 for
+ * an unknown block, -2 for a marked block, else the mine count). on_position returns false to stop the game there.
+ */
+template <class OnPosition>
+void PlayPositions(const BatchConfig &config, int games, OnPosition on_position) {
+  InitSeed(config.seed);
+  for (int g = 0; g < games; ++g) {
+    std::istringstream input(GenerateMapText(config));
+    int rows, columns, first_row, first_column;
+    input >> rows >> columns;
+    MineSweeperGame game(rows, columns);
+    game.InitMap(input);
+    input >> first_row >> first_column;
+    ClientNS::Client client;
+    client.Reset(rows, columns, game.getTotalMines());
+    client.Seed(ClientSeed(config.seed, g));
+    Grid<signed char> view(rows, columns, -1);
+    Operation op = {first_row, first_column, 0};
+    while (true) {
+      game.Execute(op.row, op.column, op.type);
+      if (game.getGameState() != 0) {
+        break;
+      }
+      for (const CellChange &change : game.getChanges()) {
+        view[change.row][change.column] = static_cast<signed char>(change.value);
+      }
+      client.Observe(game.getChanges());
+      if (!on_position(g, game, client, static_cast<const Grid<signed char> &>(view))) {
+        break;
+      }
+      op = client.NextOperation();
+    }
+  }
+}
+
+/**
+ * Full games of a configuration with each Protocol, then the output per game of the two text protocols, the whole map
+ * (PrintMap()) and only the changes (FormatChanges()), as
+ *   name games operations text_bytes delta_bytes
+ */
+void BenchProtocols(const BatchConfig &config, const std::string &label) {
+  BenchGames<MineSweeperGame>("array", config, label + "_observe", Protocol::kObserve);
+  BenchGames<MineSweeperGame>("array", config, label + "_text", Protocol::kText);
+  BenchGames<MineSweeperGame>("array", config, label + "_delta", Protocol::kDelta);
+  const int kGames = 64;
+  long long operations = 0;
+  long long text_bytes = 0;
+  long long delta_bytes = 0;
+  std::ostringstream text;
+  std::string delta;
+  PlayPositions(config, kGames, [&](int, MineSweeperGame &game, ClientNS::Client &, const Grid<signed char> &) {
+    text.str("");
+    game.PrintMap(text);
+    delta.clear();
+    FormatChanges(delta, game.getChanges(), game.getGameState());
+    ++operations;
+    text_bytes += static_cast<long long>(text.tellp());
+    delta_bytes += static_cast<long long>(delta.size());
+    return true;
+  });
+  Report("protocol_" + label + "/bytes", {{"games", kGames},
+                                          {"operations", operations},
+                                          {"text_bytes", static_cast<double>(text_bytes) / kGames},
+                                          {"delta_bytes", static_cast<double>(delta_bytes) / kGames}});
+}
+
+/**
+ * The time FrontierSolver::Solve() takes on the positions met while playing games of a configuration with the given
+ * node budget. Prints the average and the worst case as
+ *   name positions avg_ns max_ns
+ */
+void BenchSolver(const BatchConfig &config, const std::string &label, long long node_budget) {
+  using Clock = std::chrono::steady_clock;
+  const int kGames = 20;
+  ClientNS::SolverOptions options;
+  options.node_budget = node_budget;
+  ClientNS::FrontierSolver solver(options);
+  long long positions = 0;
+  double total = 0;
+  double worst = 0;
+  PlayPositions(config, kGames,
+                [&](int, MineSweeperGame &game, ClientNS::Client &, const Grid<signed char> &view) {
+                  auto start = Clock::now();
+                  solver.Solve(view, game.getTotalMines());
+                  double elapsed = std::chrono::duration<double>(Clock::now() - start).count() * 1e9;
+                  total += elapsed;
+                  worst = std::max(worst, elapsed);
+                  ++positions;
+                  return true;
+                });
+  Report("solver_" + label + "/budget_" + std::to_string(node_budget),
+         {{"positions", positions}, {"avg_ns", total / positions}, {"max_ns", worst}});
+}
+
+/**
+ * FrontierSolver::Solve() on the positions met while playing games of a configuration, without and with a pattern
+ * cache shared by all of them (pattern_cache.h), and the number of positions solved exactly without the cache that get
+ * other probabilities with it (0 expected; the cache only changes the positions where the node budget binds). Prints
+ *   name positions avg_ns cached_avg_ns hit_rate different
+ */
+void BenchPatternCache(const BatchConfig &config, const std::string &label, size_t slots) {
+  using Clock = std::chrono::steady_clock;
+  const int kGames = 200;
+  std::vector<Grid<signed char>> positions;
+  std::vector<int> total_mines;
+  PlayPositions(config, kGames,
+                [&](int, MineSweeperGame &game, ClientNS::Client &, const Grid<signed char> &view) {
+                  positions.push_back(view);
+                  total_mines.push_back(game.getTotalMines());
+                  return true;
+                });
+  ClientNS::PatternCache cache(slots);
+  ClientNS::SolverOptions cached_options;
+  cached_options.cache = &cache;
+  ClientNS::FrontierSolver solver;
+  ClientNS::FrontierSolver cached_solver(cached_options);
+  double seconds[2] = {0, 0};
+  long long different = 0;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    auto start = Clock::now();
+    solver.Solve(positions[i], total_mines[i]);
+    auto middle = Clock::now();
+    cached_solver.Solve(positions[i], total_mines[i]);
+    auto end = Clock::now();
+    seconds[0] += std::chrono::duration<double>(middle - start).count();
+    seconds[1] += std::chrono::duration<double>(end - middle).count();
+    if (!solver.Exact()) {
+      continue;
+    }
+    bool same = solver.SafeBlocks() == cached_solver.SafeBlocks() && solver.MineBlocks() == cached_solver.MineBlocks();
+    for (size_t block = 0; block < positions[i].Size() && same; ++block) {
+      same = solver.Probability(static_cast<int>(block)) == cached_solver.Probability(static_cast<int>(block));
+    }
+    different += !same;
+  }
+  double count = std::max<double>(positions.size(), 1);
+  Report("pattern_cache_" + label + "/slots_" + std::to_string(slots),
+         {{"positions", positions.size()}, {"avg_ns", seconds[0] / count * 1e9},
+          {"cached_avg_ns", seconds[1] / count * 1e9}, {"hit_rate", cache.HitRate()}, {"different", different}});
+}
+
+// Generating maps with the text GenerateMap() of the judger and with BoardGenerator into a byte buffer (from the
+// stream of gen or from a counter-based generator per board) or an arena.
+void BenchGenerate(const BatchConfig &config, const std::string &label) {
+  InitSeed(config.seed);
+  Run("generate_" + label + "/text", [&] { sink = GenerateMapText(config).size(); });
+  BoardGenerator generator(config.rows, config.columns, config.mine_count, config.min_dist);
+  std::vector<unsigned char> bytes(static_cast<size_t>(config.rows) * config.columns);
+  Run("generate_" + label + "/bytes", [&] {
+    int first_row, first_column;
+    generator.Generate(gen, bytes.data(), first_row, first_column);
+    sink = first_row;
+  });
+  uint64_t index = 0;
+  Run("generate_" + label + "/bytes_philox", [&] {
+    Philox4x32 random = BoardRandom(config.seed, index++);
+    int first_row, first_column;
+    generator.Generate(random, bytes.data(), first_row, first_column);
+    sink = first_row;
+  });
+  // Boards per call of the arena benchmark: the arena is cleared, not freed, between calls.
+  const int kArenaBoards = 1024;
+  BoardArena arena;
+  arena.Assign(config.rows, config.columns);
+  Run("generate_" + label + "/arena_x" + std::to_string(kArenaBoards), [&] {
+    arena.Clear();
+    generator.Generate(gen, arena, kArenaBoards);
+    sink = arena.FirstRow(0);
+  });
+}
+
+/**
+ * Loading the maps of a batch into MineSweeperGame from text with InitMap(std::istream &), and from a corpus file
+ * mapped by CorpusReader with InitMap(const uint64_t *).
+ */
+void BenchCorpusLoad(const BatchConfig &config, const std::string &label) {
+  const int kBoards = 4096;
+  const std::string path = "/tmp/minesweeper_bench_" + label + ".corpus";
+  std::vector<std::string> texts;
+  CorpusWriter writer;
+  writer.Open(path);
+  BatchConfig boards = config;
+  boards.games = kBoards;
+  GenerateBatchBoards(boards, [&](const CorpusBoard &board) {
+    std::ostringstream text;
+    WriteTextBoard(text, board);
+    texts.push_back(text.str());
+    writer.Add(board);
+  });
+  writer.Close();
+  CorpusReader corpus;
+  corpus.Open(path);
+  int next = 0;
+  Run("load_" + label + "/text", [&] {
+    MineSweeperGame game = LoadGame<MineSweeperGame>(texts[next]);
+    sink = game.getTotalMines();
+    next = (next + 1) % kBoards;
+  });
+  Run("load_" + label + "/corpus", [&] {
+    CorpusBoard board = corpus.Board(next);
+    MineSweeperGame game(board.rows, board.columns);
+    game.InitMap(board.mines);
+    sink = game.getTotalMines();
+    next = (next + 1) % kBoards;
+  });
+  std::remove(path.c_str());
+}
+
+/**
+ * The blocks a single visited block proves safe or mines on its own: the rules of Client::DetectBlock() applied to the
+ * visited blocks in the 3 * 3 area of every changed block. Blocks are reported once, like GaussianDeducer does.
+ */
+class SingleBlockDeducer {
+ public:
+  void Reset(int rows, int columns) { reported_.Assign(rows, columns, false); }
+
+  void Update(const Grid<signed char> &map, const std::vector<int> &changed) {
+    safe_.clear();
+    mines_.clear();
+    for (int block : changed) {
+      reported_.At(block) = false;
+    }
+    for (int block : changed) {
+      int r = block / map.Columns();
+      int c = block % map.Columns();
+      for (int x = std::max(r - 1, 0); x <= std::min(r + 1, map.Rows() - 1); ++x) {
+        for (int y = std::max(c - 1, 0); y <= std::min(c + 1, map.Columns() - 1); ++y) {
+          Detect(map, x, y);
+        }
+      }
+    }
+  }
+
+  const std::vector<int> &SafeBlocks() const { return safe_; }
+  const std::vector<int> &MineBlocks() const { return mines_; }
+
+ private:
+  void Detect(const Grid<signed char> &map, int r, int c) {
+    if (map[r][c] < 0) {
+      return;
+    }
+    int unknown = 0;
+    int marked = 0;
+    for (int x = std::max(r - 1, 0); x <= std::min(r + 1, map.Rows() - 1); ++x) {
+      for (int y = std::max(c - 1, 0); y <= std::min(c + 1, map.Columns() - 1); ++y) {
+        unknown += map[x][y] == -1;
+        marked += map[x][y] == -2;
+      }
+    }
+    if (unknown == 0 || (map[r][c] != marked && map[r][c] != marked + unknown)) {
+      return;
+    }
+    std::vector<int> &blocks = map[r][c] == marked ? safe_ : mines_;
+    for (int x = std::max(r - 1, 0); x <= std::min(r + 1, map.Rows() - 1); ++x) {
+      for (int y = std::max(c - 1, 0); y <= std::min(c + 1, map.Columns() - 1); ++y) {
+        if (map[x][y] == -1 && !reported_[x][y]) {
+          reported_[x][y] = true;
+          blocks.push_back(x * map.Columns() + y);
+        }
+      }
+    }
+  }
+
+  Grid<bool> reported_;
+  std::vector<int> safe_;
+  std::vector<int> mines_;
+};
+
+/**
+ * The blocks deduced per microsecond by a deducer (SingleBlockDeducer or ClientNS::GaussianDeducer), fed with the
+ * blocks changed by every operation of games played by the default client. Every deduction is checked against the
+ * map. Prints
+ *   name positions deductions deductions_per_us
+ */
+template <class Deducer>
+void BenchDeducer(const BatchConfig &config, const std::string &label, const std::string &deducer_name) {
+  using Clock = std::chrono::steady_clock;
+  const int kGames = 200;
+  long long positions = 0;
+  long long deductions = 0;
+  double elapsed = 0;
+  Deducer deducer;
+  int current_game = -1;
+  std::vector<int> changed;
+  PlayPositions(config, kGames, [&](int g, MineSweeperGame &game, ClientNS::Client &, const Grid<signed char> &view) {
+    if (g != current_game) {
+      current_game = g;
+      deducer.Reset(view.Rows(), view.Columns());
+    }
+    changed.clear();
+    for (const CellChange &change : game.getChanges()) {
+      changed.push_back(change.row * view.Columns() + change.column);
+    }
+    auto start = Clock::now();
+    deducer.Update(view, changed);
+    elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+    ++positions;
+    deductions += deducer.SafeBlocks().size() + deducer.MineBlocks().size();
+    // Reveal the map to check the deductions: the mines are exactly the blocks PrintMap_win() prints as '@'.
+    std::stringstream truth;
+    game.PrintMap_win(truth);
+    std::string solution((std::istreambuf_iterator<char>(truth)), std::istreambuf_iterator<char>());
+    solution.erase(std::remove(solution.begin(), solution.end(), '\n'), solution.end());
+    for (int block : deducer.SafeBlocks()) {
+      if (solution[block] == '@') {
+        std::cerr << "WRONG safe block " << block << " in game " << g << std::endl;
+      }
+    }
+    for (int block : deducer.MineBlocks()) {
+      if (solution[block] != '@') {
+        std::cerr << "WRONG mine block " << block << " in game " << g << std::endl;
+      }
+    }
+    return true;
+  });
+  Report("deduce_" + label + "/" + deducer_name,
+         {{"positions", positions}, {"deductions", deductions}, {"deductions_per_us", deductions / (elapsed * 1e6)}});
+}
+
+/**
+ * Plays games of config with two clients in lockstep, one deducing incrementally (SetIncremental(true)) and one
+ * rescanning the whole map (the default), and checks that both choose the same operation at every decision. A game
+ * stops at its first divergence, which is printed. Prints
+ *   name games decisions divergences incremental_ns_per_decision rescan_ns_per_decision
+ */
+void BenchIncremental(const BatchConfig &config, const std::string &label) {
+  using Clock = std::chrono::steady_clock;
+  const int kGames = 300;
+  long long decisions = 0;
+  long long divergences = 0;
+  double elapsed[2] = {};
+  // The client of PlayPositions() plays the games; it decides like the rescanning one as long as they agree.
+  ClientNS::Client clients[2];
+  int current_game = -1;
+  PlayPositions(config, kGames, [&](int g, MineSweeperGame &game, ClientNS::Client &, const Grid<signed char> &view) {
+    if (g != current_game) {
+      current_game = g;
+      for (int i = 0; i < 2; ++i) {
+        clients[i].Reset(view.Rows(), view.Columns(), game.getTotalMines());
+        clients[i].Seed(ClientSeed(config.seed, g));
+        clients[i].SetIncremental(i == 0);
+      }
+    }
+    Operation ops[2];
+    // Alternate which client goes first, so that neither always runs on the caches of the other.
+    for (int k = 0; k < 2; ++k) {
+      int i = (k + decisions) & 1;
+      clients[i].Observe(game.getChanges());
+      auto start = Clock::now();
+      ops[i] = clients[i].NextOperation();
+      elapsed[i] += std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    ++decisions;
+    if (ops[0].row != ops[1].row || ops[0].column != ops[1].column || ops[0].type != ops[1].type) {
+      std::cerr << "DIVERGED in game " << g << " at decision " << decisions << ": incremental (" << ops[0].row << ", "
+                << ops[0].column << ", " << ops[0].type << "), rescan (" << ops[1].row << ", " << ops[1].column << ", "
+                << ops[1].type << ")" << std::endl;
+      ++divergences;
+      return false;
+    }
+    return true;
+  });
+  double per_decision = 1e9 / std::max(decisions, 1LL);
+  Report("incremental_" + label, {{"games", kGames},
+                                  {"decisions", decisions},
+                                  {"divergences", divergences},
+                                  {"incremental_ns_per_decision", elapsed[0] * per_decision},
+                                  {"rescan_ns_per_decision", elapsed[1] * per_decision}});
+}
+
+/**
+ * The cost of one hypothetical reveal of a lookahead: set an unknown frontier block to a mine count (and, for the
+ * *_propagate results, propagate the single-block rules), then go back to the position. Compares the undo log of
+ * KnowledgeState (Snapshot() and Restore()) with cloning the KnowledgeState and with cloning the whole Client, on
+ * positions of games of config. Reports
+ *   name hypotheses ns_per_hypothesis
+ */
+void BenchLookahead(const BatchConfig &config, const std::string &label) {
+  using Clock = std::chrono::steady_clock;
+  const int kGames = 20;
+  long long hypotheses = 0;
+  double elapsed[2][3] = {};
+  std::vector<int> frontier;
+  PlayPositions(config, kGames, [&](int, MineSweeperGame &, ClientNS::Client &client, const Grid<signed char> &view) {
+    int rows = view.Rows();
+    int columns = view.Columns();
+    ClientNS::KnowledgeState &knowledge = client.Knowledge();
+    // The unknown blocks next to a visited block.
+    frontier.clear();
+    for (int r = 0; r < rows; ++r) {
+      for (int c = 0; c < columns; ++c) {
+        bool next_to_visited = false;
+        for (int x = std::max(r - 1, 0); x <= std::min(r + 1, rows - 1); ++x) {
+          for (int y = std::max(c - 1, 0); y <= std::min(c + 1, columns - 1); ++y) {
+            next_to_visited = next_to_visited || knowledge.Map()[x][y] >= 0;
+          }
+        }
+        if (knowledge.Map()[r][c] == -1 && next_to_visited) {
+          frontier.push_back(r * columns + c);
+        }
+      }
+    }
+    // Every frontier block with every mine count its neighbours allow.
+    auto hypothesize = [&](auto &&apply) {
+      for (int block : frontier) {
+        int r = block / columns;
+        int c = block % columns;
+        int marked = knowledge.MarkedCount(r, c);
+        for (int value = marked; value <= marked + knowledge.UnknownCount(r, c); ++value) {
+          apply(r, c, value);
+        }
+      }
+    };
+    for (int block : frontier) {
+      hypotheses += knowledge.UnknownCount(block / columns, block % columns) + 1;
+    }
+    // Without and with propagation, so that the cost of cloning and restoring shows apart from the rules.
+    long long count = 0;
+    for (int propagate = 0; propagate < 2; ++propagate) {
+      auto start = Clock::now();
+      hypothesize([&](int r, int c, int value) {
+        knowledge.Snapshot();
+        knowledge.Set(r, c, value);
+        count += propagate ? knowledge.Propagate(r, c) : 1;
+        knowledge.Restore();
+      });
+      auto undo_end = Clock::now();
+      hypothesize([&](int r, int c, int value) {
+        ClientNS::KnowledgeState copy = knowledge;
+        copy.Set(r, c, value);
+        count += propagate ? copy.Propagate(r, c) : 1;
+      });
+      auto copy_end = Clock::now();
+      hypothesize([&](int r, int c, int value) {
+        ClientNS::Client copy = client;
+        copy.Knowledge().Set(r, c, value);
+        count += propagate ? copy.Knowledge().Propagate(r, c) : 1;
+      });
+      auto client_end = Clock::now();
+      elapsed[propagate][0] += std::chrono::duration<double>(undo_end - start).count();
+      elapsed[propagate][1] += std::chrono::duration<double>(copy_end - undo_end).count();
+      elapsed[propagate][2] += std::chrono::duration<double>(client_end - copy_end).count();
+    }
+    sink = count;
+    return true;
+  });
+  const char *const kNames[] = {"undo_log", "copy_state", "copy_client"};
+  for (int propagate = 0; propagate < 2; ++propagate) {
+    for (int i = 0; i < 3; ++i) {
+      Report("lookahead_" + label + "/" + kNames[i] + (propagate ? "_propagate" : ""),
+             {{"hypotheses", hypotheses},
+              {"ns_per_hypothesis", elapsed[propagate][i] * 1e9 / std::max(hypotheses, 1LL)}});
+    }
+  }
+}
+
+/**
+ * Applies random sequences of Set(), Propagate() and nested Snapshot(), Commit() and Restore() to KnowledgeStates of
+ * 1 * 1 to 30 * 30 maps, and checks that every Restore() gives back exactly the map and the counters of a copy taken
+ * at its Snapshot(), and that the counters then match the map. Prints every mismatch, then
+ *   knowledge_undo sequences restores mismatches
+ */
+void CheckKnowledgeUndo() {
+  const int kSequences = 2000;
+  const int kSteps = 200;
+  const int kMaxDepth = 8;
+  std::mt19937 rng(20241018);
+  long long restores = 0;
+  long long mismatches = 0;
+  // The map, then MarkedCount() and UnknownCount() of every block.
+  auto picture = [](const ClientNS::KnowledgeState &knowledge) {
+    std::vector<int> values;
+    for (int r = 0; r < knowledge.Rows(); ++r) {
+      for (int c = 0; c < knowledge.Columns(); ++c) {
+        values.push_back(knowledge.Map()[r][c]);
+        values.push_back(knowledge.MarkedCount(r, c));
+        values.push_back(knowledge.UnknownCount(r, c));
+      }
+    }
+    return values;
+  };
+  // Whether the counters of every block count its marked and unknown neighbours.
+  auto counted = [](const ClientNS::KnowledgeState &knowledge) {
+    const Grid<signed char> &map = knowledge.Map();
+    for (int r = 0; r < knowledge.Rows(); ++r) {
+      for (int c = 0; c < knowledge.Columns(); ++c) {
+        int marked = 0;
+        int unknown = 0;
+        for (int k = 0; k < 8; ++k) {
+          int x = r + kNeighbourRow[k];
+          int y = c + kNeighbourColumn[k];
+          if (x >= 0 && x < knowledge.Rows() && y >= 0 && y < knowledge.Columns()) {
+            marked += map[x][y] == ClientNS::KnowledgeState::kMarked;
+            unknown += map[x][y] == ClientNS::KnowledgeState::kUnknown;
+          }
+        }
+        if (knowledge.MarkedCount(r, c) != marked || knowledge.UnknownCount(r, c) != unknown) {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+  for (int s = 0; s < kSequences; ++s) {
+    int rows = static_cast<int>(rng() % 30) + 1;
+    int columns = static_cast<int>(rng() % 30) + 1;
+    auto block = [&](int &r, int &c) {
+      r = static_cast<int>(rng() % rows);
+      c = static_cast<int>(rng() % columns);
+    };
+    // Any content: kSafe, kMarked, kUnknown or a mine count.
+    auto value = [&] { return static_cast<int>(rng() % 12) - 3; };
+    ClientNS::KnowledgeState knowledge;
+    knowledge.Reset(rows, columns);
+    int r, c;
+    // A random position to start from, not logged.
+    for (int i = 0; i < rows * columns / 3; ++i) {
+      block(r, c);
+      knowledge.Set(r, c, value());
+    }
+    std::vector<std::vector<int>> snapshots;  // The picture at every open Snapshot()
+    auto restore = [&](int step) {
+      knowledge.Restore();
+      ++restores;
+      if (picture(knowledge) != snapshots.back() || !counted(knowledge)) {
+        ++mismatches;
+        std::cerr << "knowledge_undo: sequence " << s << " (" << rows << "x" << columns << "), step " << step
+                  << ": Restore() at depth " << snapshots.size() << " does not give back the snapshot" << std::endl;
+      }
+      snapshots.pop_back();
+    };
+    for (int step = 0; step < kSteps; ++step) {
+      switch (rng() % 6) {
+        case 0:
+        case 1:
+          block(r, c);
+          knowledge.Set(r, c, value());
+          break;
+        case 2:
+          block(r, c);
+          knowledge.Propagate(r, c);
+          break;
+        case 3:
+          if (snapshots.size() < kMaxDepth) {
+            snapshots.push_back(picture(knowledge));
+            knowledge.Snapshot();
+          }
+          break;
+        case 4:
+          if (!snapshots.empty()) {
+            knowledge.Commit();
+            snapshots.pop_back();
+          }
+          break;
+        default:
+          if (!snapshots.empty()) {
+            restore(step);
+          }
+      }
+    }
+    while (!snapshots.empty()) {
+      restore(kSteps);
+    }
+  }
+  Report("knowledge_undo", {{"sequences", kSequences}, {"restores", restores}, {"mismatches", mismatches}});
+}
+
+/**
+ * Load a saved position of testcases/positions: a line "rows columns total_mines", then the map as PrintMap() prints
+ * it while the game continues.
+ */
+bool LoadPosition(const std::string &path, Grid<signed char> &map, int &total_mines) {
+  std::ifstream input(path);
+  int rows, columns;
+  if (!(input >> rows >> columns >> total_mines)) {
+    return false;
+  }
+  map.Assign(rows, columns, -1);
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < columns; ++j) {
+      char ch;
+      input >> ch;
+      map[i][j] = static_cast<signed char>(ch == '?' ? -1 : ch == '@' ? -2 : ch - '0');
+    }
+  }
+  return static_cast<bool>(input);
+}
+
+/**
+ * The time of an exact Solve() on saved hard positions with 1, 2, 4, ... threads up to the hardware threads (at least
+ * 4, so that the parallel path is checked on small machines too). Every result is checked to be bit-identical to the
+ * sequential one.
+ */
+void BenchEnumerationScaling() {
+  int max_threads = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int index = 1;; ++index) {
+    std::string name = "hard" + std::to_string(index);
+    Grid<signed char> map;
+    int total_mines;
+    if (!LoadPosition(std::string(MINESWEEPER_TESTCASES) + "/positions/" + name + ".txt", map, total_mines)) {
+      break;
+    }
+    ClientNS::SolverOptions options;
+    options.node_budget = 1LL << 40;
+    ClientNS::FrontierSolver sequential(options);
+    sequential.Solve(map, total_mines);
+    for (int threads = 1;; threads = std::min(threads * 2, max_threads)) {
+      options.threads = threads;
+      ClientNS::FrontierSolver solver(options);
+      Run("enumerate_" + name + "/threads_" + std::to_string(threads), [&] { solver.Solve(map, total_mines); });
+      for (size_t block = 0; block < map.Size(); ++block) {
+        double expected = sequential.Probability(static_cast<int>(block));
+        double actual = solver.Probability(static_cast<int>(block));
+        if (std::memcmp(&expected, &actual, sizeof(double)) != 0) {
+          std::cerr << "MISMATCH " << name << " threads " << threads << " block " << block << std::endl;
+          break;
+        }
+      }
+      if (threads == max_threads) {
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * The accuracy of the probabilities of a Solve() cut short by a small node budget on the saved hard positions, against
+ * the exact ones: first with the partial counts of the enumeration, then with the components estimated by
+ * SampleComponent() under time budgets of 1 to 256 ms. Reports
+ *   name milliseconds samples mean_error max_error guess_regret
+ * where the errors are the mean and largest absolute error over the unknown blocks, and guess_regret is how much more
+ * likely than the best block the block chosen by BestGuess() is to be a mine.
+ */
+void BenchSampling() {
+  using Clock = std::chrono::steady_clock;
+  for (int index = 1;; ++index) {
+    std::string name = "hard" + std::to_string(index);
+    Grid<signed char> map;
+    int total_mines;
+    if (!LoadPosition(std::string(MINESWEEPER_TESTCASES) + "/positions/" + name + ".txt", map, total_mines)) {
+      break;
+    }
+    ClientNS::SolverOptions options;
+    options.node_budget = 1LL << 40;
+    ClientNS::FrontierSolver exact(options);
+    exact.Solve(map, total_mines);
+    double best = 1;
+    for (size_t block = 0; block < map.Size(); ++block) {
+      if (map.At(block) == -1) {
+        best = std::min(best, exact.Probability(static_cast<int>(block)));
+      }
+    }
+    auto measure = [&](const std::string &label, const ClientNS::SolverOptions &approximate_options) {
+      ClientNS::FrontierSolver solver(approximate_options);
+      solver.Seed(index);
+      auto start = Clock::now();
+      solver.Solve(map, total_mines);
+      double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+      double total_error = 0;
+      double max_error = 0;
+      int unknown = 0;
+      for (size_t block = 0; block < map.Size(); ++block) {
+        if (map.At(block) == -1) {
+          double error = std::fabs(solver.Probability(static_cast<int>(block)) -
+                                   exact.Probability(static_cast<int>(block)));
+          total_error += error;
+          max_error = std::max(max_error, error);
+          ++unknown;
+        }
+      }
+      std::mt19937 rng(index);
+      double regret = exact.Probability(solver.BestGuess(rng)) - best;
+      Report("sample_" + name + "/" + label, {{"milliseconds", elapsed},
+                                              {"samples", solver.Samples()},
+                                              {"mean_error", total_error / std::max(unknown, 1)},
+                                              {"max_error", max_error},
+                                              {"guess_regret", regret}});
+    };
+    options.node_budget = 1 << 16;
+    measure("partial", options);
+    options.sample_budget = 1LL << 40;
+    for (int milliseconds : {1, 4, 16, 64, 256}) {
+      options.sample_seconds = milliseconds / 1000.0;
+      measure("sampled_" + std::to_string(milliseconds) + "ms", options);
+    }
+  }
+}
+
+/**
+ * Read the configuration of testcases/advanced/batch<index>.in into config. Returns false if there is no such file.
+ */
+bool LoadBatchConfig(int index, BatchConfig &config) {
+  std::ifstream input(std::string(MINESWEEPER_TESTCASES) + "/advanced/batch" + std::to_string(index) + ".in");
+  return static_cast<bool>(input >> config.rows >> config.columns >> config.mine_count >> config.seed >>
+                           config.min_dist);
+}
+
+/**
+ * End-to-end batches of every testcases/advanced/batch*.in configuration (generation and games, as `client --batch`)
+ * on one thread and on every hardware thread. Reports
+ *   name games seconds games_per_second
+ */
+void BenchBatches() {
+  using Clock = std::chrono::steady_clock;
+  const int kGames = 2000;
+  int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  BatchConfig config;
+  for (int index = 1; LoadBatchConfig(index, config); ++index) {
+    config.games = kGames;
+    for (int threads : {1, hardware}) {
+      config.threads = threads;
+      auto start = Clock::now();
+      BatchSummary summary = Summarize(RunBatch(config));
+      double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+      Report("batch" + std::to_string(index) + "/threads_" + std::to_string(threads),
+             {{"games", summary.games}, {"seconds", elapsed}, {"games_per_second", summary.games / elapsed}});
+      if (hardware == 1) {
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * End-to-end games against a referee process (referee.h) over pipes: a child forked from the benchmark serves the
+ * requests, like `server --referee`, while this process plays with in_flight games in flight. Reports
+ *   name games games_per_second requests latency_p50_us latency_p90_us latency_p99_us latency_max_us
+ */
+void BenchReferee(const BatchConfig &config, const std::string &label) {
+  const int kGames = 2000;
+  signal(SIGPIPE, SIG_IGN);
+  for (int in_flight : {1, 4, 16, 64}) {
+    int requests[2];
+    int answers[2];
+    if (pipe(requests) != 0 || pipe(answers) != 0) {
+      std::cerr << "Cannot create the pipes of the referee" << std::endl;
+      return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(requests[1]);
+      close(answers[0]);
+      _exit(ServeReferee(requests[0], answers[1]) ? 0 : 1);
+    }
+    close(requests[0]);
+    close(answers[1]);
+    BatchConfig batch = config;
+    batch.games = kGames;
+    std::vector<GameResult> results;
+    RefereeStats stats;
+    std::string error;
+    bool ok = pid > 0 && PlayReferee(batch, answers[0], requests[1], in_flight, results, stats, &error);
+    close(requests[1]);
+    close(answers[0]);
+    if (pid > 0) {
+      waitpid(pid, nullptr, 0);
+    }
+    if (!ok) {
+      std::cerr << "referee_" << label << ": " << (pid > 0 ? error : "cannot fork") << std::endl;
+      return;
+    }
+    Report("referee_" + label + "/in_flight_" + std::to_string(in_flight),
+           {{"games", kGames},
+            {"games_per_second", kGames / stats.seconds},
+            {"requests", stats.requests},
+            {"latency_p50_us", Percentile(stats.latencies, 0.5)},
+            {"latency_p90_us", Percentile(stats.latencies, 0.9)},
+            {"latency_p99_us", Percentile(stats.latencies, 0.99)},
+            {"latency_max_us", Percentile(stats.latencies, 1)}});
+  }
+}
+
+// The resident memory of process pid in bytes (VmRSS in /proc/pid/status), or 0 if it cannot be read.
+double ResidentBytes(pid_t pid) {
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmRSS:") == 0) {
+      return std::atof(line.c_str() + 6) * 1024;
+    }
+  }
+  return 0;
+}
+
+// The CPU time (user and system) used so far by process pid in seconds (from /proc/pid/stat), or 0.
+double CpuSeconds(pid_t pid) {
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string line;
+  std::getline(stat, line);
+  // The fields after the command name, which is in parentheses and may contain spaces.
+  size_t end = line.rfind(')');
+  if (end == std::string::npos) {
+    return 0;
+  }
+  std::istringstream fields(line.substr(end + 2));
+  std::string field;
+  double ticks = 0;
+  for (int i = 3; i <= 15 && fields >> field; ++i) {
+    if (i >= 14) {
+      ticks += std::atof(field.c_str());  // utime and stime
+    }
+  }
+  return ticks / sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * A load generator for `server --sessions` (session.h): a child forked from the benchmark serves a table of live
+ * sessions over pipes, like the server would, while this process opens live sessions on boards of config and then
+ * sends kOperations operations round-robin over all of them. Every session visits the safe blocks it has not seen
+ * yet, in row-major order from its first step, and marks one of its mines every 8th operation; a session whose game
+ * is over is replaced by a new one on a new board, so that live sessions stay open. The requests in flight are
+ * bounded so that the answers to all of them fit in the pipe, so neither end can block the other. Reports
+ *   name live operations operations_per_second server_ns_per_operation games_recycled bytes_per_session
+ * where bytes_per_session is the resident memory of the child beyond that of a child with an empty table.
+ */
+void BenchSessions(const BatchConfig &config, const std::string &label) {
+  const long long kOperations = 1000000;
+  signal(SIGPIPE, SIG_IGN);
+  const int rows = config.rows;
+  const int columns = config.columns;
+  const int blocks = rows * columns;
+  const size_t words = (static_cast<size_t>(blocks) + 63) / 64;
+  // The largest request (an open) and answer (an operation changing every block), in bytes.
+  const size_t max_request = static_cast<size_t>(rows) * (columns + 1) + 32;
+  const size_t max_answer = static_cast<size_t>(blocks) * 12 + 64;
+  double empty_bytes = 0;
+  for (int live : {0, 1000, 10000, 100000}) {
+    int requests[2];
+    int answers[2];
+    if (pipe(requests) != 0 || pipe(answers) != 0) {
+      std::cerr << "Cannot create the pipes of the sessions" << std::endl;
+      return;
+    }
+    for (int fd : {requests[1], answers[1]}) {
+      fcntl(fd, F_SETPIPE_SZ, 1 << 20);
+    }
+    int pipe_bytes = std::min(fcntl(requests[1], F_GETPIPE_SZ), fcntl(answers[1], F_GETPIPE_SZ));
+    pipe_bytes = pipe_bytes > 0 ? pipe_bytes : 1 << 16;
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(requests[1]);
+      close(answers[0]);
+      _exit(ServeSessions(requests[0], answers[1], live, rows, columns) ? 0 : 1);
+    }
+    close(requests[0]);
+    close(answers[1]);
+    if (pid < 0) {
+      std::cerr << "sessions_" << label << ": cannot fork" << std::endl;
+      close(requests[1]);
+      close(answers[0]);
+      return;
+    }
+    FastReader in(answers[0]);
+    FastWriter out(requests[1]);
+    std::string word;
+    bool ok = true;
+    auto fail = [&](const std::string &message) {
+      if (ok) {
+        std::cerr << "sessions_" << label << "/live_" << live << ": " << message << std::endl;
+      }
+      ok = false;
+    };
+
+    // The state of every session: its board, the blocks it knows (visited or marked) and where it looks next.
+    std::vector<uint64_t> mines(words * live);
+    std::vector<uint64_t> known(words * live);
+    std::vector<int> ids(live, -1);
+    std::vector<int> next_visit(live);
+    std::vector<int> next_mark(live);
+    std::vector<long long> operations(live);
+    std::vector<int> in_flight;  // The sessions of the requests in flight, in order
+    size_t answered = 0;         // The answered prefix of in_flight
+    BoardGenerator generator(rows, columns, config.mine_count, config.min_dist);
+    std::mt19937_64 random(config.seed);
+    auto bit = [words](std::vector<uint64_t> &set, int session, int block) -> bool {
+      return set[session * words + (block >> 6)] >> (block & 63) & 1;
+    };
+    auto set_bit = [words](std::vector<uint64_t> &set, int session, int block) {
+      set[session * words + (block >> 6)] |= 1ULL << (block & 63);
+    };
+    auto open = [&](int session) {
+      uint64_t *board = &mines[session * words];
+      int first_row, first_column;
+      generator.Generate(random, board, first_row, first_column);
+      std::fill(&known[session * words], &known[session * words] + words, 0);
+      next_visit[session] = first_row * columns + first_column;
+      next_mark[session] = 0;
+      std::string &buffer = out.Buffer();
+      buffer += "open " + std::to_string(rows) + " " + std::to_string(columns) + "\n";
+      for (int block = 0; block < blocks; ++block) {
+        buffer += bit(mines, session, block) ? 'X' : '.';
+        if (block % columns == columns - 1) {
+          buffer += '\n';
+        }
+      }
+      in_flight.push_back(session);
+    };
+    auto operate = [&](int session) {
+      int type = 0;
+      int block = next_visit[session];
+      if (++operations[session] % 8 == 0) {
+        while (next_mark[session] < blocks && !bit(mines, session, next_mark[session])) {
+          ++next_mark[session];
+        }
+        if (next_mark[session] < blocks) {
+          block = next_mark[session]++;
+          type = 1;
+        }
+      }
+      if (type == 0) {
+        // The game is not over, so some safe block is still unknown.
+        while (bit(mines, session, block) || bit(known, session, block)) {
+          block = block + 1 < blocks ? block + 1 : 0;
+        }
+        next_visit[session] = block;
+      }
+      std::string &buffer = out.Buffer();
+      buffer += std::to_string(ids[session]) + " " + std::to_string(block / columns) + " " +
+                std::to_string(block % columns) + " " + std::to_string(type) + "\n";
+      in_flight.push_back(session);
+    };
+    // Read the answer to the oldest request in flight. Returns whether it ended the game of its session.
+    long long games_recycled = 0;
+    auto receive = [&]() {
+      int session = in_flight[answered++];
+      int count, game_state;
+      // Only wait for the server once every answer already received has been handled.
+      in.SkipBufferedSpaces();
+      if ((in.Buffered() == 0 && !out.Flush()) || !in.ReadWord(word) || word == "error" || !in.ReadInt(count) ||
+          !in.ReadInt(game_state)) {
+        fail(word == "error" ? "the server answered an error" : "the server closed the connection");
+        return false;
+      }
+      ids[session] = ParseSessionId(word);
+      for (int i = 0; i < count; ++i) {
+        int row, column, value;
+        if (!in.ReadInt(row) || !in.ReadInt(column) || !in.ReadInt(value)) {
+          fail("bad answer");
+          return false;
+        }
+        set_bit(known, session, row * columns + column);
+      }
+      if (game_state != 0) {
+        int visit_count, marked_count;
+        if (!in.ReadInt(visit_count) || !in.ReadInt(marked_count)) {
+          fail("bad answer");
+          return false;
+        }
+        ids[session] = -1;
+        ++games_recycled;
+        return true;
+      }
+      return false;
+    };
+    int window = static_cast<int>(std::min<size_t>(pipe_bytes / std::max(max_request, max_answer), live));
+    window = std::max(window, 1);
+
+    // Open every session.
+    for (int session = 0; session < live && ok; ++session) {
+      if (static_cast<int>(in_flight.size() - answered) == window) {
+        receive();
+      }
+      open(session);
+    }
+    while (answered < in_flight.size() && ok) {
+      receive();
+    }
+
+    // Operate round-robin: when the answer of a session arrives, the next session in turn gets a request. It is never
+    // in flight already since there are at least window sessions, but it may be opening again (without an id yet).
+    using Clock = std::chrono::steady_clock;
+    double cpu_start = CpuSeconds(pid);
+    auto start = Clock::now();
+    in_flight.clear();
+    answered = 0;
+    games_recycled = 0;
+    long long sent = 0;
+    int turn = 0;
+    for (; turn < window && sent < kOperations && live > 0; ++turn, ++sent) {
+      operate(turn);
+    }
+    while (answered < in_flight.size() && ok) {
+      int session = in_flight[answered];
+      if (receive()) {
+        open(session);
+      } else if (sent < kOperations) {
+        while (ids[turn] < 0) {
+          turn = turn + 1 < live ? turn + 1 : 0;
+        }
+        operate(turn);
+        turn = turn + 1 < live ? turn + 1 : 0;
+        ++sent;
+      }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double cpu_seconds = CpuSeconds(pid) - cpu_start;
+
+    out.Write("stats\n");
+    if (ok && !(out.Flush() && in.ReadWord(word) && word == "sessions" && in.ReadInt(turn) && turn == live)) {
+      fail("the server lost sessions");
+    }
+    double bytes = ResidentBytes(pid);
+    close(requests[1]);
+    close(answers[0]);
+    waitpid(pid, nullptr, 0);
+    if (!ok) {
+      return;
+    }
+    if (live == 0) {
+      empty_bytes = bytes;
+      continue;
+    }
+    Report("sessions_" + label + "/live_" + std::to_string(live),
+           {{"live", live},
+            {"operations", sent},
+            {"operations_per_second", sent / seconds},
+            {"server_ns_per_operation", cpu_seconds * 1e9 / sent},
+            {"games_recycled", games_recycled},
+            {"bytes_per_session", (bytes - empty_bytes) / live}});
+  }
+}
+
+BatchConfig Config(int rows, int columns, int mine_count, uint64_t seed, int min_dist) {
+  BatchConfig config;
+  config.rows = rows;
+  config.columns = columns;
+  config.mine_count = mine_count;
+  config.seed = seed;
+  config.min_dist = min_dist;
+  return config;
+}
+
+/**
+ * Configures a referee process of its own with each of a few batch configurations at the limits of kConfigure, and
+ * checks that it accepts the ones whose mines fit outside the min_dist of every first step and answers "Bad
+ * kConfigure" to the others instead of crashing. Prints every mismatch, then
+ *   referee_configure configurations mismatches
+ */
+void CheckRefereeConfigure() {
+  struct Case {
+    BatchConfig config;
+    bool valid;
+  };
+  const Case cases[] = {
+      {Config(3, 3, 8, 1, 0), true},   {Config(3, 3, 9, 1, 0), false},  {Config(5, 5, 12, 1, 2), true},
+      {Config(5, 5, 13, 1, 2), false}, {Config(5, 5, 20, 1, 2), false}, {Config(2, 5, 1, 1, 0), false},
+      {Config(5, 2, 1, 1, 0), false},  {Config(5, 5, 1, 1, -1), false}, {Config(10, 10, 9, 1, 2), true},
+  };
+  signal(SIGPIPE, SIG_IGN);
+  int mismatches = 0;
+  for (const Case &c : cases) {
+    int requests[2];
+    int answers[2];
+    if (pipe(requests) != 0 || pipe(answers) != 0) {
+      std::cerr << "Cannot create the pipes of the referee" << std::endl;
+      return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(requests[1]);
+      close(answers[0]);
+      _exit(ServeReferee(requests[0], answers[1]) ? 0 : 1);
+    }
+    close(requests[0]);
+    close(answers[1]);
+    BatchConfig batch = c.config;
+    batch.games = 1;
+    std::vector<GameResult> results;
+    RefereeStats stats;
+    std::string error;
+    bool ok = pid > 0 && PlayReferee(batch, answers[0], requests[1], 1, results, stats, &error);
+    close(requests[1]);
+    close(answers[0]);
+    int status = 0;
+    if (pid > 0) {
+      waitpid(pid, &status, 0);
+    }
+    bool rejected = !ok && error == "The referee failed: Bad kConfigure";
+    if (WIFSIGNALED(status) || (c.valid ? !ok : !rejected)) {
+      ++mismatches;
+      std::cerr << "referee_configure " << batch.rows << "x" << batch.columns << "x" << batch.mine_count
+                << " min_dist " << batch.min_dist << ": expected " << (c.valid ? "kReady" : "Bad kConfigure")
+                << ", got "
+                << (WIFSIGNALED(status) ? "signal " + std::to_string(WTERMSIG(status)) : ok ? "kReady" : error)
+                << std::endl;
+    }
+  }
+  Report("referee_configure", {{"configurations", sizeof(cases) / sizeof(cases[0])}, {"mismatches", mismatches}});
+}
+
+/**
+ * Usage: bench [--json] [filter]
+ * Runs the groups of benchmarks whose name contains filter (all of them by default). With --json every result is
+ * printed as a JSON object per line (see Report()).
+ */
+int main(int argc, char *argv[]) {
+  std::string filter;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0) {
+      json_output = true;
+    } else {
+      filter = argv[i];
+    }
+  }
+  auto enabled = [&](const std::string &group) { return filter.empty() || group.find(filter) != std::string::npos; };
+  if (enabled("cascade")) {
+    BenchCascade<MineSweeperGame>("array", 30);
+    BenchCascade<BitboardGame>("bitboard", 30);
+    BenchCascade<MineSweeperGame>("array", 64);
+    BenchCascade<BitboardGame>("bitboard", 64);
+  }
+  if (enabled("autoexplore")) {
+    BenchAutoExplore<MineSweeperGame>("array", 30);
+    BenchAutoExplore<BitboardGame>("bitboard", 30);
+  }
+  if (enabled("large")) {
+    // Boards beyond the bitboard limit, to check how the iterative flood fill scales.
+    BenchCascade<MineSweeperGame>("array", 1024);
+    BenchCascade<MineSweeperGame>("array", 4096);
+  }
+  if (enabled("game")) {
+    BatchConfig batch1 = Config(10, 10, 9, 19260817, 2);
+    BatchConfig batch5 = Config(20, 20, 84, 1000000007, 3);
+    BenchGames<MineSweeperGame>("array", batch1, "10x10x9");
+    BenchGames<BitboardGame>("bitboard", batch1, "10x10x9");
+    BenchGames<MineSweeperGame>("array", batch5, "20x20x84");
+    BenchGames<BitboardGame>("bitboard", batch5, "20x20x84");
+  }
+  if (enabled("protocol")) {
+    BenchProtocols(Config(30, 30, 90, 1, 2), "30x30x90");
+    BenchProtocols(Config(30, 30, 150, 20241013, 2), "30x30x150");
+  }
+  if (enabled("neighbours")) {
+    BenchNeighbours(30, 30);
+    BenchNeighbours(16, 30);
+    BenchNeighbours(64, 64);
+    BenchNeighbours(1000, 1000);
+  }
+  if (enabled("parse")) {
+    BenchParse<MineSweeperGame>("array", Config(30, 30, 180, 1, 2), "30x30x180");
+    BenchParse<BitboardGame>("bitboard", Config(30, 30, 180, 1, 2), "30x30x180");
+  }
+  if (enabled("print")) {
+    BenchPrint<MineSweeperGame>("array", Config(30, 30, 180, 1, 2), "30x30x180");
+    BenchPrint<BitboardGame>("bitboard", Config(30, 30, 180, 1, 2), "30x30x180");
+  }
+  if (enabled("solver")) {
+    BatchConfig dense = Config(30, 30, 150, 20241013, 2);
+    BenchSolver(dense, "30x30x150", 1 << 14);
+    BenchSolver(dense, "30x30x150", 1 << 20);
+  }
+  if (enabled("pattern")) {
+    BenchPatternCache(Config(30, 30, 150, 20241013, 2), "30x30x150", 4096);
+    BenchPatternCache(Config(30, 30, 200, 7, 2), "30x30x200", 4096);
+  }
+  if (enabled("generate")) {
+    BenchGenerate(Config(10, 10, 9, 19260817, 2), "10x10x9");
+    BenchGenerate(Config(20, 20, 84, 1000000007, 3), "20x20x84");
+    BenchGenerate(Config(100, 100, 2000, 1, 3), "100x100x2000");
+    // 30x30 from 10% to 50% mines.
+    for (int mines : {90, 180, 270, 450}) {
+      BenchGenerate(Config(30, 30, mines, 1, 2), "30x30x" + std::to_string(mines));
+    }
+  }
+  if (enabled("load")) {
+    BenchCorpusLoad(Config(10, 10, 9, 19260817, 2), "10x10x9");
+    BenchCorpusLoad(Config(20, 20, 84, 1000000007, 3), "20x20x84");
+  }
+  if (enabled("deduce")) {
+    // The configurations of testcases/advanced/batch*.in.
+    const BatchConfig batches[] = {Config(10, 10, 9, 19260817, 2), Config(10, 10, 15, 114514, 2),
+                                   Config(10, 10, 18, 1019260817, 2), Config(10, 10, 20, 998244353, 2),
+                                   Config(20, 20, 84, 1000000007, 3)};
+    for (int i = 0; i < 5; ++i) {
+      std::string label = "batch" + std::to_string(i + 1);
+      BenchDeducer<SingleBlockDeducer>(batches[i], label, "single_block");
+      BenchDeducer<ClientNS::GaussianDeducer>(batches[i], label, "gaussian");
+    }
+  }
+  if (enabled("incremental")) {
+    // The configurations of testcases/advanced/batch*.in, 1500 games in all.
+    const BatchConfig batches[] = {Config(10, 10, 9, 19260817, 2), Config(10, 10, 15, 114514, 2),
+                                   Config(10, 10, 18, 1019260817, 2), Config(10, 10, 20, 998244353, 2),
+                                   Config(20, 20, 84, 1000000007, 3)};
+    for (int i = 0; i < 5; ++i) {
+      BenchIncremental(batches[i], "batch" + std::to_string(i + 1));
+    }
+  }
+  if (enabled("lookahead")) {
+    BenchLookahead(Config(20, 20, 84, 1000000007, 3), "20x20x84");
+    BenchLookahead(Config(30, 30, 150, 20241013, 2), "30x30x150");
+  }
+  if (enabled("knowledge")) {
+    CheckKnowledgeUndo();
+  }
+  if (enabled("enumerate")) {
+    BenchEnumerationScaling();
+  }
+  if (enabled("sample")) {
+    BenchSampling();
+  }
+  if (enabled("batch")) {
+    BenchBatches();
+  }
+  if (enabled("sessions")) {
+    BenchSessions(Config(16, 16, 40, 1, 2), "16x16x40");
+    BenchSessions(Config(30, 30, 150, 20241013, 2), "30x30x150");
+  }
+  if (enabled("referee")) {
+    CheckRefereeConfigure();
+    BenchReferee(Config(20, 20, 84, 1000000007, 3), "20x20x84");
+    BenchReferee(Config(30, 30, 150, 20241013, 2), "30x30x150");
+  }
+}
@@ -0,0 +1,159 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "corpus.h"
+
+void Execute(int row, int column, int type) {
+  // The tool never plays through the global client.
+  std::cerr << "Unexpected global Execute(" << row << ", " << column << ", " << type << ")" << std::endl;
+  exit(-1);
+}
+
+void ExecuteBatch(const std::vector<Operation> &ops) {
+  std::cerr << "Unexpected global ExecuteBatch() of " << ops.size() << " operations" << std::endl;
+  exit(-1);
+}
+
+int Pack(const std::string &output, const std::vector<std::string> &inputs) {
+  CorpusWriter writer;
+  if (!writer.Open(output)) {
+    std::cerr << "Cannot write " << output << std::endl;
+    return 1;
+  }
+  CorpusBoard board;
+  std::vector<uint64_t> words;
+  // Returns false after reporting a board that cannot be read or written.
+  auto pack = [&](std::istream &in, const std::string &name) {
+    int count = 0;
+    while (ReadTextBoard(in, board, words)) {
+      if (!writer.Add(board)) {
+        std::cerr << "Cannot write " << output << std::endl;
+        return false;
+      }
+      ++count;
+    }
+    if (!in.eof()) {
+      std::cerr << "Bad board " << count << " in " << name << std::endl;
+      return false;
+    }
+    return true;
+  };
+  if (inputs.empty() && !pack(std::cin, "the input")) {
+    return 1;
+  }
+  for (const std::string &input : inputs) {
+    std::ifstream in(input);
+    if (!in) {
+      std::cerr << "Cannot read " << input << std::endl;
+      return 1;
+    }
+    if (!pack(in, input)) {
+      return 1;
+    }
+  }
+  int boards = writer.Size();
+  if (!writer.Close()) {
+    std::cerr << "Cannot write " << output << std::endl;
+    return 1;
+  }
+  std::cerr << boards << " boards" << std::endl;
+  return 0;
+}
+
+bool OpenCorpus(CorpusReader &corpus, const std::string &path) {
+  std::string error;
+  if (!corpus.Open(path, &error)) {
+    std::cerr << "Cannot read the corpus: " << error << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int Unpack(const std::string &input) {
+  CorpusReader corpus;
+  if (!OpenCorpus(corpus, input)) {
+    return 1;
+  }
+  std::ios::sync_with_stdio(false);
+  for (int i = 0; i < corpus.Size(); ++i) {
+    WriteTextBoard(std::cout, corpus.Board(i));
+  }
+  return 0;
+}
+
+int Info(const std::string &input) {
+  CorpusReader corpus;
+  if (!OpenCorpus(corpus, input)) {
+    return 1;
+  }
+  std::cout << "boards " << corpus.Size() << std::endl;
+  for (int i = 0; i < corpus.Size(); ++i) {
+    CorpusBoard board = corpus.Board(i);
+    std::cout << i << " " << board.rows << " " << board.columns << " " << board.mine_count << " " << board.first_row
+              << " " << board.first_column << " " << board.seed << " " << board.index << std::endl;
+  }
+  return 0;
+}
+
+int Generate(const std::string &output, const BatchConfig &config) {
+  CorpusWriter writer;
+  if (!writer.Open(output)) {
+    std::cerr << "Cannot write " << output << std::endl;
+    return 1;
+  }
+  // The boards after a failed write are not written.
+  bool written = true;
+  GenerateBatchBoards(config, [&](const CorpusBoard &board) { written = written && writer.Add(board); });
+  if (!writer.Close() || !written) {
+    std::cerr << "Cannot write " << output << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Usage:
+ *   corpus pack OUT [IN...]          convert text boards (size, map, first step, like testcases/advanced/adv*.in; any
+ *                                    number per file) from the files IN or stdin to the corpus OUT
+ *   corpus unpack IN                 print every board of the corpus IN as text
+ *   corpus info IN                   print "index rows columns mine_count first_row first_column seed index_in_run"
+ *                                    for every board of the corpus IN
+ *   corpus generate OUT [options]    read rows, columns, mine_count, seed and min_dist like `client --batch` and save
+ *                                    the maps of the batch to the corpus OUT; `client --batch --corpus OUT` then plays
+ *                                    exactly the same games. Options: --games N, --first-game I, --fast-gen, --philox
+ */
+int main(int argc, char *argv[]) {
+  std::string command = argc > 1 ? argv[1] : "";
+  if (command == "pack" && argc >= 3) {
+    return Pack(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+  } else if (command == "unpack" && argc == 3) {
+    return Unpack(argv[2]);
+  } else if (command == "info" && argc == 3) {
+    return Info(argv[2]);
+  } else if (command == "generate" && argc >= 3) {
+    BatchConfig config;
+    for (int i = 3; i < argc; ++i) {
+      if (std::strcmp(argv[i], "--games") == 0 && i + 1 < argc) {
+        config.games = std::atoi(argv[++i]);
+      } else if (std::strcmp(argv[i], "--first-game") == 0 && i + 1 < argc) {
+        config.first_game = std::atoi(argv[++i]);
+      } else if (std::strcmp(argv[i], "--fast-gen") == 0) {
+        config.fast_generator = true;
+      } else if (std::strcmp(argv[i], "--philox") == 0) {
+        config.counter_rng = true;
+      } else {
+        std::cerr << "Unknown option " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    std::cin >> config.rows >> config.columns >> config.mine_count >> config.seed >> config.min_dist;
+    return Generate(argv[2], config);
+  }
+  std::cerr << "Usage: corpus pack OUT [IN...] | unpack IN | info IN | generate OUT [options]" << std::endl;
+  return 1;
+}
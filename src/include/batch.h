@@ -0,0 +1,444 @@
+/**
+ * This header file implements the batch evaluator used by `client --batch`.
+ *
+ * A batch plays many random maps generated by generator.h with the same parameters as TestBatch() (rows, columns,
+ * mine count, random seed and minimum distance to the first step). Every game owns its MineSweeperGame and Client, so
+ * the games are spread over a work-stealing thread pool. Maps are generated in order from the seed, and the client of
+ * game i is seeded from (seed, i) only, so the result of every game does not depend on the number of threads. With
+ * BatchConfig::counter_rng map i comes from its own counter-based generator, BoardRandom(seed, i), so the maps are
+ * generated by the tasks in parallel and any game can be replayed alone with first_game. With
+ * BatchConfig::fast_generator the maps are written by BoardGenerator straight into a BoardArena instead of being
+ * printed and parsed as text. With BatchConfig::corpus the games are played on the boards of a corpus (corpus.h). With
+ * BatchConfig::replay every game is recorded, in order, to a replay log (replay.h).
+ *
+ * Built with MINESWEEPER_METRICS, every GameResult also carries the metrics (metrics.h) recorded during its game.
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "client.h"
+#include "corpus.h"
+#include "generator.h"
+#include "metrics.h"
+#include "replay.h"
+#include "server.h"
+#include "thread_pool.h"
+
+struct BatchConfig {
+  int rows = 0;
+  int columns = 0;
+  int mine_count = 0;
+  uint64_t seed = 0;
+  int min_dist = 0;
+  int games = 50;
+  int threads = 0;                       // 0 for one thread per hardware thread
+  Protocol protocol = Protocol::kObserve;  // How the result of every operation is passed to the client
+  bool bitboard = false;                  // Use BitboardGame instead of MineSweeperGame as the server
+  bool fast_generator = false;            // Generate the maps with BoardGenerator (not the maps of GenerateMap())
+  bool counter_rng = false;               // Generate map i from BoardRandom(seed, i) instead of the stream of gen
+  int first_game = 0;                     // The index of the first game, to replay a part of a run
+  const CorpusReader *corpus = nullptr;  // Play the boards of a corpus instead of generating maps
+  ReplayWriter *replay = nullptr;        // Record every game to this log, if not null
+  ClientNS::SolverOptions solver;
+};
+
+struct GameResult {
+  int game_state = 0;  // 1 for winning, -1 for losing
+  int visit_count = 0;
+  int marked_count = 0;
+#ifdef MINESWEEPER_METRICS
+  Metrics::GameMetrics metrics;
+#endif
+};
+
+struct BatchSummary {
+  int games = 0;
+  int wins = 0;
+  long long visit_count = 0;
+  long long marked_count = 0;
+};
+
+/**
+ * The seed of the client of game index in a batch with the given seed (SplitMix64).
+ */
+inline unsigned ClientSeed(uint64_t seed, int index) {
+  uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (static_cast<uint64_t>(index) + 1);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return static_cast<unsigned>(z ^ (z >> 31));
+}
+
+/**
+ * Generate a map of the batch with random as the text GenerateMap() prints.
+ */
+template <class Rng>
+std::string GenerateMapText(const BatchConfig &config, Rng &random) {
+  METRICS_PHASE(kGenerate);
+  std::ostringstream oss;
+  GenerateMap(config.rows, config.columns, config.mine_count, config.min_dist, random, oss);
+  return oss.str();
+}
+
+/**
+ * Generate the next map of the batch from the stream of gen.
+ */
+inline std::string GenerateMapText(const BatchConfig &config) {
+  return GenerateMapText(config, gen);
+}
+
+/**
+ * Play a whole game from the first step on a game with its map loaded, without touching any global state. The
+ * operations executed are recorded to recorder, if not null.
+ */
+template <class Game>
+GameResult PlayLoadedGame(Game &game, int first_row, int first_column, unsigned client_seed, Protocol protocol,
+                          const ClientNS::SolverOptions &solver, ReplayRecorder *recorder = nullptr) {
+  if (recorder != nullptr) {
+    recorder->Start(game);
+  }
+  ClientNS::Client client;
+  client.Reset(game.getRows(), game.getColumns(), game.getTotalMines());
+  client.Seed(client_seed);
+  client.SetSolverOptions(solver);
+  // The certain operations the client queues together are executed and observed as one batch.
+  std::vector<Operation> ops = {{first_row, first_column, 0}};
+  while (true) {
+    {
+      METRICS_PHASE(kExecute);
+      size_t executed = game.ExecuteBatch(ops);
+      for (size_t i = 0; recorder != nullptr && i < executed; ++i) {
+        recorder->Add(ops[i]);
+      }
+    }
+    if (game.getGameState() != 0) {
+      break;
+    }
+    {
+      METRICS_PHASE(kTransport);
+      if (protocol == Protocol::kText) {
+        std::stringstream map;
+        game.PrintMap(map);
+        client.ReadMap(map);
+      } else if (protocol == Protocol::kDelta) {
+        std::string delta;
+        FormatChanges(delta, game.getChanges(), game.getGameState());
+        std::istringstream in(delta);
+        client.ReadChanges(in);
+      } else {
+        client.Observe(game.getChanges());
+      }
+    }
+    client.NextOperations(ops);
+  }
+  METRICS_GAME_OVER(game.getGameState() == -1);
+  if (recorder != nullptr) {
+    recorder->Finish(game);
+  }
+  GameResult result;
+  result.game_state = game.getGameState();
+  result.visit_count = game.getVisitCount();
+  result.marked_count = game.getMarkedCount();
+  return result;
+}
+
+/**
+ * Play a whole game on a map in the format of GenerateMap() (size, map, first step).
+ * Game is the server backend, MineSweeperGame or BitboardGame.
+ */
+template <class Game = MineSweeperGame>
+GameResult PlayGame(const std::string &map_text, unsigned client_seed, Protocol protocol,
+                    const ClientNS::SolverOptions &solver = ClientNS::SolverOptions(),
+                    ReplayRecorder *recorder = nullptr) {
+  std::istringstream input(map_text);
+  int rows, columns;
+  input >> rows >> columns;
+  Game game(rows, columns);
+  int first_row, first_column;
+  {
+    METRICS_PHASE(kLoad);
+    game.InitMap(input);
+    input >> first_row >> first_column;
+  }
+  return PlayLoadedGame(game, first_row, first_column, client_seed, protocol, solver, recorder);
+}
+
+/**
+ * Play a whole game on board index of arena.
+ */
+template <class Game = MineSweeperGame>
+GameResult PlayBoard(const BoardArena &arena, int index, unsigned client_seed, Protocol protocol,
+                     const ClientNS::SolverOptions &solver = ClientNS::SolverOptions(),
+                     ReplayRecorder *recorder = nullptr) {
+  Game game(arena.Rows(), arena.Columns());
+  {
+    METRICS_PHASE(kLoad);
+    game.InitMap(arena.Mines(index));
+  }
+  return PlayLoadedGame(game, arena.FirstRow(index), arena.FirstColumn(index), client_seed, protocol, solver,
+                        recorder);
+}
+
+// Play a game of the batch on a map in the format of GenerateMap(), with the backend and options of config.
+inline GameResult PlayBatchMap(const BatchConfig &config, const std::string &map, unsigned client_seed,
+                               ReplayRecorder *recorder = nullptr) {
+  return config.bitboard ? PlayGame<BitboardGame>(map, client_seed, config.protocol, config.solver, recorder)
+                         : PlayGame<MineSweeperGame>(map, client_seed, config.protocol, config.solver, recorder);
+}
+
+// Play a game of the batch on board index of arena.
+inline GameResult PlayBatchBoard(const BatchConfig &config, const BoardArena &arena, int index, unsigned client_seed,
+                                 ReplayRecorder *recorder = nullptr) {
+  return config.bitboard
+             ? PlayBoard<BitboardGame>(arena, index, client_seed, config.protocol, config.solver, recorder)
+             : PlayBoard<MineSweeperGame>(arena, index, client_seed, config.protocol, config.solver, recorder);
+}
+
+// Play a game of the batch on a board of a corpus, loading its map straight from the mapped file.
+inline GameResult PlayCorpusBoard(const BatchConfig &config, const CorpusBoard &board,
+                                  ReplayRecorder *recorder = nullptr) {
+  unsigned client_seed = ClientSeed(board.seed, static_cast<int>(board.index));
+  if (config.bitboard) {
+    BitboardGame game(board.rows, board.columns);
+    {
+      METRICS_PHASE(kLoad);
+      game.InitMap(board.mines);
+    }
+    return PlayLoadedGame(game, board.first_row, board.first_column, client_seed, config.protocol, config.solver,
+                          recorder);
+  }
+  MineSweeperGame game(board.rows, board.columns);
+  {
+    METRICS_PHASE(kLoad);
+    game.InitMap(board.mines);
+  }
+  return PlayLoadedGame(game, board.first_row, board.first_column, client_seed, config.protocol, config.solver,
+                        recorder);
+}
+
+/**
+ * Store the result of play() in result. Built with MINESWEEPER_METRICS, the metrics recorded by this thread during
+ * play() are stored in result.metrics.
+ */
+template <class Play>
+void RecordGame(GameResult &result, Play play) {
+#ifdef MINESWEEPER_METRICS
+  Metrics::GameMetrics metrics;
+  Metrics::Recorder recorder(&metrics);
+  result = play();
+  result.metrics = metrics;
+#else
+  result = play();
+#endif
+}
+
+/**
+ * Play game i of config (game first_game + i of the run, on a board generated from seed as game index) with play,
+ * which is passed the recorder of the game, or null if the batch is not recorded. The record is added to config.replay
+ * at position i.
+ */
+template <class Play>
+GameResult PlayRecorded(const BatchConfig &config, int i, uint64_t seed, uint64_t index, Play play) {
+  if (config.replay == nullptr) {
+    return play(nullptr);
+  }
+  ReplayRecorder recorder(seed, index);
+  GameResult result = play(&recorder);
+  config.replay->Add(i, recorder.Record());
+  return result;
+}
+
+/**
+ * Generate the maps of config (games first_game, first_game + 1, ...) in order, just like RunBatch() does, and pass
+ * every one to add as a CorpusBoard with the seed and index of the game. Used to save a batch as a corpus.
+ */
+template <class Add>
+void GenerateBatchBoards(const BatchConfig &config, Add add) {
+  BoardGenerator generator(config.rows, config.columns, config.mine_count, config.min_dist);
+  std::vector<uint64_t> words(CorpusWords(config.rows, config.columns));
+  CorpusBoard board;
+  auto generate = [&](auto &random, int index) {
+    if (config.fast_generator) {
+      generator.Generate(random, words.data(), board.first_row, board.first_column);
+      board.rows = config.rows;
+      board.columns = config.columns;
+      board.mines = words.data();
+    } else {
+      std::istringstream input(GenerateMapText(config, random));
+      ReadTextBoard(input, board, words);
+    }
+    board.seed = config.seed;
+    board.index = index;
+  };
+  if (!config.counter_rng) {
+    InitSeed(config.seed);
+    for (int i = 0; i < config.first_game; ++i) {
+      generate(gen, i);
+    }
+  }
+  for (int i = 0; i < config.games; ++i) {
+    int index = config.first_game + i;
+    if (config.counter_rng) {
+      Philox4x32 random = BoardRandom(config.seed, index);
+      generate(random, index);
+    } else {
+      generate(gen, index);
+    }
+    add(static_cast<const CorpusBoard &>(board));
+  }
+}
+
+/**
+ * Play config.games games (games first_game, first_game + 1, ... of the run) and return their results in order.
+ */
+inline std::vector<GameResult> RunBatch(const BatchConfig &config) {
+  const int kChunkGames = 1 << 14;
+  const int kTaskGames = 16;
+  std::vector<GameResult> results(config.games);
+  ThreadPool pool(config.threads);
+  METRICS_BATCH();
+  if (config.corpus != nullptr) {
+    for (int begin = 0; begin < config.games; begin += kTaskGames) {
+      int end = std::min(config.games, begin + kTaskGames);
+      pool.Submit([&, begin, end] {
+        for (int i = begin; i < end; ++i) {
+          CorpusBoard board = config.corpus->Board(config.first_game + i);
+          RecordGame(results[i], [&] {
+            return PlayRecorded(config, i, board.seed, board.index,
+                                [&](ReplayRecorder *recorder) { return PlayCorpusBoard(config, board, recorder); });
+          });
+        }
+      });
+    }
+    pool.Wait();
+    return results;
+  }
+  if (config.counter_rng) {
+    // Every board has its own generator, so the tasks generate their maps themselves.
+    for (int begin = 0; begin < config.games; begin += kTaskGames) {
+      int end = std::min(config.games, begin + kTaskGames);
+      pool.Submit([&, begin, end] {
+        BoardGenerator generator(config.rows, config.columns, config.mine_count, config.min_dist);
+        BoardArena arena;
+        arena.Assign(config.rows, config.columns);
+        for (int i = begin; i < end; ++i) {
+          int index = config.first_game + i;
+          RecordGame(results[i], [&] {
+            return PlayRecorded(config, i, config.seed, index, [&](ReplayRecorder *recorder) {
+              Philox4x32 random = BoardRandom(config.seed, index);
+              if (config.fast_generator) {
+                {
+                  METRICS_PHASE(kGenerate);
+                  arena.Clear();
+                  generator.Generate(random, arena, 1);
+                }
+                return PlayBatchBoard(config, arena, 0, ClientSeed(config.seed, index), recorder);
+              }
+              return PlayBatchMap(config, GenerateMapText(config, random), ClientSeed(config.seed, index), recorder);
+            });
+          });
+        }
+      });
+    }
+    pool.Wait();
+    return results;
+  }
+  // Maps are generated in chunks by this thread, in order from the stream of gen, and played by the pool.
+  std::vector<std::string> maps;
+  BoardArena arena;
+  arena.Assign(config.rows, config.columns);
+  BoardGenerator generator(config.rows, config.columns, config.mine_count, config.min_dist);
+  InitSeed(config.seed);
+  for (int skipped = 0; skipped < config.first_game; skipped += kChunkGames) {
+    int count = std::min(kChunkGames, config.first_game - skipped);
+    if (config.fast_generator) {
+      arena.Clear();
+      generator.Generate(gen, arena, count);
+    } else {
+      for (int i = 0; i < count; ++i) {
+        GenerateMapText(config);
+      }
+    }
+  }
+  for (int chunk_begin = 0; chunk_begin < config.games; chunk_begin += kChunkGames) {
+    int chunk_end = std::min(config.games, chunk_begin + kChunkGames);
+    if (config.fast_generator) {
+      METRICS_PHASE(kGenerate);
+      arena.Clear();
+      generator.Generate(gen, arena, chunk_end - chunk_begin);
+    } else {
+      maps.clear();
+      for (int i = chunk_begin; i < chunk_end; ++i) {
+        maps.push_back(GenerateMapText(config));
+      }
+    }
+    for (int begin = chunk_begin; begin < chunk_end; begin += kTaskGames) {
+      int end = std::min(chunk_end, begin + kTaskGames);
+      pool.Submit([&, begin, end, chunk_begin] {
+        for (int i = begin; i < end; ++i) {
+          unsigned client_seed = ClientSeed(config.seed, config.first_game + i);
+          RecordGame(results[i], [&] {
+            return PlayRecorded(config, i, config.seed, config.first_game + i, [&](ReplayRecorder *recorder) {
+              return config.fast_generator ? PlayBatchBoard(config, arena, i - chunk_begin, client_seed, recorder)
+                                           : PlayBatchMap(config, maps[i - chunk_begin], client_seed, recorder);
+            });
+          });
+        }
+      });
+    }
+    pool.Wait();
+  }
+  return results;
+}
+
+inline BatchSummary Summarize(const std::vector<GameResult> &results) {
+  BatchSummary summary;
+  for (const GameResult &result : results) {
+    ++summary.games;
+    summary.wins += result.game_state == 1;
+    summary.visit_count += result.visit_count;
+    summary.marked_count += result.marked_count;
+  }
+  return summary;
+}
+
+#ifdef MINESWEEPER_METRICS
+/**
+ * Write the metrics of every game as CSV: a header, then "index,game_state,visit_count,marked_count,..." per game.
+ */
+inline void WriteMetricsCsv(std::ostream &out, const std::vector<GameResult> &results, int first_game) {
+  out << "index,game_state,visit_count,marked_count";
+  Metrics::WriteCsvHeader(out);
+  out << "\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    out << first_game + i << "," << results[i].game_state << "," << results[i].visit_count << ","
+        << results[i].marked_count;
+    Metrics::WriteCsvRow(out, results[i].metrics);
+    out << "\n";
+  }
+}
+
+/**
+ * Write the metrics of a batch summed over its games as a JSON object. The maps a sequential batch generates outside
+ * of the games (Metrics::BatchMetrics()) are included in the generate phase.
+ */
+inline void WriteMetricsJson(std::ostream &out, const std::vector<GameResult> &results) {
+  Metrics::GameMetrics total = Metrics::BatchMetrics();
+  uint64_t losses = 0;
+  for (const GameResult &result : results) {
+    total.Add(result.metrics);
+    losses += result.game_state == -1;
+  }
+  out << "{\n  \"games\": " << results.size() << ",\n  \"wins\": " << results.size() - losses << ",\n";
+  Metrics::WriteJsonMembers(out, total, results.size(), losses);
+  out << "\n}\n";
+}
+#endif
+
+#endif
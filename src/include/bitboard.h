@@ -0,0 +1,326 @@
+/**
+ * This header file implements BitboardGame, a bitboard backend of MineSweeperGame.
+ *
+ * Every row of the map is stored as one 64-bit word for mines, visited blocks and marked blocks, so a whole game takes
+ * about 2 KB instead of about 8 KB. Mine counts are not stored: they are the popcount of a 3 * 3 window of the mine
+ * words. Visiting a block with mine count 0 opens the whole connected area of such blocks with a word-parallel flood
+ * fill instead of one recursive call per block.
+ *
+ * BitboardGame behaves exactly like MineSweeperGame for VisitBlock(), MarkMine(), AutoExplore(), the PrintMap*()
+ * functions and the counters, so it can be used wherever MineSweeperGame is (e.g. PlayGame() in batch.h). Maps are
+ * limited to 64 * 64 blocks.
+ */
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "metrics.h"
+#include "observation.h"
+
+class BitboardGame {
+ public:
+  static const int kMaxSize = 64;
+
+  BitboardGame() : BitboardGame(0, 0) {}
+  BitboardGame(int r, int c) : rows_(r), columns_(c), total_mines_(0), game_state_(0), marked_count_(0),
+                               visit_count_(0) {
+    full_ = columns_ >= 64 ? ~0ULL : (1ULL << columns_) - 1;
+    for (int i = 0; i < kMaxSize; ++i) {
+      mines_[i] = visited_[i] = marked_[i] = zero_[i] = 0;
+    }
+  }
+
+  void InitMap(std::istream &in = std::cin) {
+    char ch;
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < columns_; ++j) {
+        in >> ch;
+        if (ch == 'X') {
+          mines_[i] |= Bit(j);
+          ++total_mines_;
+        }
+      }
+    }
+    FindZeroBlocks();
+  }
+
+  // Initialize the map from packed bits: bit r * columns + c of mines is set for a mine (see BoardArena).
+  void InitMap(const uint64_t *mines) {
+    size_t words = (static_cast<size_t>(rows_) * columns_ + 63) / 64;
+    for (size_t w = 0; w < words; ++w) {
+      for (uint64_t bits = mines[w]; bits; bits &= bits - 1) {
+        size_t block = w * 64 + __builtin_ctzll(bits);
+        mines_[block / columns_] |= Bit(block % columns_);
+        ++total_mines_;
+      }
+    }
+    FindZeroBlocks();
+  }
+
+  void VisitBlock(int r, int c) {
+    if (r < 0 || r >= rows_ || c < 0 || c >= columns_ || ((marked_[r] | visited_[r]) & Bit(c))) {
+      return;
+    }
+    if (mines_[r] & Bit(c)) {
+      visited_[r] |= Bit(c);
+      RecordChange(r, c);
+      game_state_ = -1;
+      return;
+    }
+    if (!(zero_[r] & Bit(c))) {
+      visited_[r] |= Bit(c);
+      RecordChange(r, c);
+      ++visit_count_;
+    } else {
+      METRICS_CASCADE(visit_count_);
+      OpenArea(r, c);
+    }
+    if (visit_count_ == rows_ * columns_ - total_mines_) {
+      game_state_ = 1;
+    }
+  }
+
+  void MarkMine(int r, int c) {
+    if (r < 0 || r >= rows_ || c < 0 || c >= columns_ || ((marked_[r] | visited_[r]) & Bit(c))) {
+      return;
+    }
+    marked_[r] |= Bit(c);
+    RecordChange(r, c);
+    if (mines_[r] & Bit(c)) {
+      ++marked_count_;
+    } else {
+      game_state_ = -1;
+    }
+  }
+
+  void AutoExplore(int r, int c) {
+    if (r < 0 || r >= rows_ || c < 0 || c >= columns_ || !(visited_[r] & Bit(c)) || (mines_[r] & Bit(c))) {
+      return;
+    }
+    if (WindowCount(marked_, r, c) != WindowCount(mines_, r, c)) {
+      return;
+    }
+    for (int x = r - 1; x <= r + 1; ++x) {
+      for (int y = c - 1; y <= c + 1; ++y) {
+        VisitBlock(x, y);
+      }
+    }
+  }
+
+  void Execute(int r, int c, int type) {
+    BeginOperation();
+    if (type == 0) {
+      VisitBlock(r, c);
+    } else if (type == 1) {
+      MarkMine(r, c);
+    } else if (type == 2) {
+      AutoExplore(r, c);
+    }
+  }
+
+  // See MineSweeperGame::ExecuteBatch().
+  size_t ExecuteBatch(const std::vector<Operation> &ops) {
+    BeginOperation();
+    size_t executed = 0;
+    while (executed < ops.size() && game_state_ == 0) {
+      const Operation &op = ops[executed++];
+      if (op.type == 0) {
+        VisitBlock(op.row, op.column);
+      } else if (op.type == 1) {
+        MarkMine(op.row, op.column);
+      } else if (op.type == 2) {
+        AutoExplore(op.row, op.column);
+      }
+    }
+    return executed;
+  }
+
+  void PrintMap(std::ostream &out = std::cout) const {
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < columns_; ++j) {
+        if (marked_[i] & Bit(j)) {
+          out << "@";
+        } else if (visited_[i] & Bit(j)) {
+          out << MineCount(i, j);
+        } else {
+          out << "?";
+        }
+      }
+      out << std::endl;
+    }
+  }
+
+  void PrintMap_win(std::ostream &out = std::cout) const {
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < columns_; ++j) {
+        if (mines_[i] & Bit(j)) {
+          out << "@";
+        } else {
+          out << MineCount(i, j);
+        }
+      }
+      out << std::endl;
+    }
+  }
+
+  void PrintMap_lose(std::ostream &out = std::cout) const {
+    for (int i = 0; i < rows_; ++i) {
+      for (int j = 0; j < columns_; ++j) {
+        bool mine = mines_[i] & Bit(j);
+        bool visited = visited_[i] & Bit(j);
+        bool marked = marked_[i] & Bit(j);
+        if (visited || marked) {
+          if ((mine && visited) || (!mine && marked)) {
+            out << "X";
+          } else if (mine) {
+            out << "@";
+          } else {
+            out << MineCount(i, j);
+          }
+        } else {
+          out << "?";
+        }
+      }
+      out << std::endl;
+    }
+  }
+
+  int MineCount(int r, int c) const { return WindowCount(mines_, r, c); }
+
+  int VisibleValue(int r, int c) const {
+    if (marked_[r] & Bit(c)) {
+      return -2;
+    }
+    return (visited_[r] & Bit(c)) ? MineCount(r, c) : -1;
+  }
+
+  void BeginOperation() { changes_.clear(); }
+  const CellChanges &getChanges() const { return changes_; }
+
+  int getRows() const { return rows_; }
+  int getColumns() const { return columns_; }
+  int getTotalMines() const { return total_mines_; }
+  int getGameState() const { return game_state_; }
+  bool isMine(int r, int c) const { return (mines_[r] & Bit(c)) != 0; }
+  int getVisitCount() const { return visit_count_; }
+  int getMarkedCount() const { return game_state_ == 1 ? total_mines_ : marked_count_; }
+
+ private:
+  static uint64_t Bit(int c) { return 1ULL << c; }
+
+  // The blocks of a row next to or at the blocks in x.
+  uint64_t Dilate(uint64_t x) const { return (x | (x << 1) | (x >> 1)) & full_; }
+
+  // The number of blocks set in the 3 * 3 window around (r, c).
+  int WindowCount(const uint64_t *plane, int r, int c) const {
+    uint64_t window = Dilate(Bit(c));
+    int count = __builtin_popcountll(plane[r] & window);
+    if (r > 0) {
+      count += __builtin_popcountll(plane[r - 1] & window);
+    }
+    if (r + 1 < rows_) {
+      count += __builtin_popcountll(plane[r + 1] & window);
+    }
+    return count - ((plane[r] >> c) & 1);
+  }
+
+  /**
+   * Visit the area of blocks with mine count 0 connected to (r, c), together with its border. The area grows by
+   * dilating it inside zero_ one row at a time, sweeping down and up until nothing changes. Blocks with mine count 0
+   * have no mine next to them, so the border never contains a mine.
+   */
+  void OpenArea(int r, int c) {
+    uint64_t area[kMaxSize] = {};
+    area[r] = Bit(c);
+    int top = r;
+    int bottom = r;
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      // Sweep down then up over the rows next to the area, growing it with the rows already updated in this sweep.
+      for (int pass = 0; pass < 2; ++pass) {
+        int i = pass == 0 ? top - 1 : bottom + 1;
+        for (; pass == 0 ? i <= bottom + 1 : i >= top - 1; i += pass == 0 ? 1 : -1) {
+          if (i < 0 || i >= rows_) {
+            continue;
+          }
+          uint64_t row = area[i];
+          if (i > 0) {
+            row |= area[i - 1];
+          }
+          if (i + 1 < rows_) {
+            row |= area[i + 1];
+          }
+          row = Dilate(row) & zero_[i] & ~marked_[i];
+          if ((row & ~area[i]) == 0) {
+            continue;
+          }
+          // Spread along the row until the runs of zero blocks are filled.
+          uint64_t next;
+          while ((next = (Dilate(row) & zero_[i] & ~marked_[i]) | row) != row) {
+            row = next;
+          }
+          area[i] |= row;
+          changed = true;
+          top = i < top ? i : top;
+          bottom = i > bottom ? i : bottom;
+        }
+      }
+    }
+    int first = top > 0 ? top - 1 : 0;
+    int last = bottom + 1 < rows_ ? bottom + 1 : rows_ - 1;
+    for (int i = first; i <= last; ++i) {
+      uint64_t open = area[i];
+      if (i > 0) {
+        open |= area[i - 1];
+      }
+      if (i + 1 < rows_) {
+        open |= area[i + 1];
+      }
+      open = Dilate(open) & ~marked_[i] & ~visited_[i];
+      if (open == 0) {
+        continue;
+      }
+      visited_[i] |= open;
+      visit_count_ += __builtin_popcountll(open);
+      while (open) {
+        RecordChange(i, __builtin_ctzll(open));
+        open &= open - 1;
+      }
+    }
+  }
+
+  // Blocks with mine count 0: not a mine and no mine in the 3 * 3 window.
+  void FindZeroBlocks() {
+    for (int i = 0; i < rows_; ++i) {
+      uint64_t near = Dilate(mines_[i]);
+      if (i > 0) {
+        near |= Dilate(mines_[i - 1]);
+      }
+      if (i + 1 < rows_) {
+        near |= Dilate(mines_[i + 1]);
+      }
+      zero_[i] = full_ & ~near;
+    }
+  }
+
+  void RecordChange(int r, int c) { changes_.push_back({r, c, VisibleValue(r, c)}); }
+
+  int rows_;
+  int columns_;
+  int total_mines_;
+  int game_state_;  // 0 for continuing, 1 for winning, -1 for losing
+  int marked_count_;
+  int visit_count_;
+  uint64_t full_;  // The blocks of a row inside the map
+  uint64_t mines_[kMaxSize];
+  uint64_t visited_[kMaxSize];
+  uint64_t marked_[kMaxSize];
+  uint64_t zero_[kMaxSize];  // Blocks with mine count 0
+  CellChanges changes_;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * This header file implements Grid, the runtime-sized map storage shared by the server, the client and the generator.
+ *
+ * A Grid is one contiguous row-major array, so grid[r][c] works just like the fixed-size arrays it replaces, but the
+ * size of the map is only limited by memory. Grid<bool> stores one byte per block (not std::vector<bool>), so that
+ * grid[r][c] is a plain reference.
+ *
+ * PaddedGrid has the same interface, but surrounds the map with a border of one block on every side, filled with a
+ * sentinel value. Together with the linear offsets of NeighbourOffsets(), the 8 neighbours of a block are visited
+ * without any bounds check: the sentinel of the border stops the loop instead (e.g. a border that reads as visited
+ * stops the flood fill of MineSweeperGame::VisitBlock()).
+ */
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// The relative rows and columns of the 8 neighbours of a block, in the order every neighbour loop visits them.
+constexpr int kNeighbourRow[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+constexpr int kNeighbourColumn[8] = {1, -1, 0, 0, 1, -1, -1, 1};
+
+// The index offsets of the 8 neighbours of a block in a row-major array of rows of width elements.
+constexpr std::array<int, 8> NeighbourOffsets(int width) {
+  std::array<int, 8> offsets{};
+  for (int k = 0; k < 8; ++k) {
+    offsets[k] = kNeighbourRow[k] * width + kNeighbourColumn[k];
+  }
+  return offsets;
+}
+
+static_assert(NeighbourOffsets(32)[2] == 32 && NeighbourOffsets(32)[7] == -31, "Offsets follow kNeighbourRow/Column");
+
+template <class T>
+class Grid {
+ public:
+  typedef typename std::conditional<std::is_same<T, bool>::value, unsigned char, T>::type Value;
+
+  Grid() : rows_(0), columns_(0) {}
+  Grid(int rows, int columns, T value = T()) { Assign(rows, columns, value); }
+
+  /**
+   * Resize the grid to rows * columns and fill it with value. The memory is reused if it is large enough.
+   */
+  void Assign(int rows, int columns, T value = T()) {
+    rows_ = rows;
+    columns_ = columns;
+    data_.assign(static_cast<size_t>(rows) * columns, static_cast<Value>(value));
+  }
+
+  void Fill(T value) { data_.assign(data_.size(), static_cast<Value>(value)); }
+
+  Value *operator[](int r) { return data_.data() + static_cast<size_t>(r) * columns_; }
+  const Value *operator[](int r) const { return data_.data() + static_cast<size_t>(r) * columns_; }
+
+  // Access by the row-major index r * columns + c.
+  Value &At(size_t index) { return data_[index]; }
+  const Value &At(size_t index) const { return data_[index]; }
+
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
+  size_t Size() const { return data_.size(); }
+
+ private:
+  int rows_;
+  int columns_;
+  std::vector<Value> data_;
+};
+
+/**
+ * A Grid with a border of one block around the map. Block (r, c) is at the padded index (r + 1) * Stride() + c + 1,
+ * so grid[r][c] still works (and grid[r][-1] or grid[-1][c] read the border), and the neighbours of the block at
+ * index are at index + offset for every offset of Offsets().
+ */
+template <class T>
+class PaddedGrid {
+ public:
+  typedef typename Grid<T>::Value Value;
+
+  PaddedGrid() { Assign(0, 0); }
+
+  /**
+   * Resize the grid to rows * columns, fill the map with value and the border with border. The memory is reused if it
+   * is large enough.
+   */
+  void Assign(int rows, int columns, T value = T(), T border = T()) {
+    rows_ = rows;
+    columns_ = columns;
+    stride_ = columns + 2;
+    offsets_ = NeighbourOffsets(stride_);
+    data_.assign(static_cast<size_t>(stride_) * (rows + 2), static_cast<Value>(border));
+    for (int r = 0; r < rows; ++r) {
+      std::fill_n((*this)[r], columns, static_cast<Value>(value));
+    }
+  }
+
+  Value *operator[](int r) { return data_.data() + static_cast<size_t>(r + 1) * stride_ + 1; }
+  const Value *operator[](int r) const { return data_.data() + static_cast<size_t>(r + 1) * stride_ + 1; }
+
+  // Access by the padded index, see Index().
+  Value &At(size_t index) { return data_[index]; }
+  const Value &At(size_t index) const { return data_[index]; }
+
+  // The padded index of block (r, c), of the row-major index block = r * Columns() + c, and back.
+  int Index(int r, int c) const { return (r + 1) * stride_ + c + 1; }
+  int BlockIndex(int block) const { return Index(block / columns_, block % columns_); }
+  int Row(int index) const { return index / stride_ - 1; }
+  int Column(int index) const { return index % stride_ - 1; }
+
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
+  // The distance between the padded indices of two vertically adjacent blocks.
+  int Stride() const { return stride_; }
+  const std::array<int, 8> &Offsets() const { return offsets_; }
+
+ private:
+  int rows_;
+  int columns_;
+  int stride_;
+  std::array<int, 8> offsets_;
+  std::vector<Value> data_;
+};
+
+#endif
@@ -1,12 +1,22 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <utility>
 #include <vector>
 #include <queue>
 #include <cstring>
 #include <cstdlib>
+#include <random>
+
+#include "board.h"
+#include "gauss.h"
+#include "knowledge.h"
+#include "metrics.h"
+#include "observation.h"
+#include "solver.h"
 
 extern int rows;         // The count of rows of the game map.
 extern int columns;      // The count of columns of the game map.
@@ -29,116 +39,347 @@ extern int total_mines;  // The count of mines of the game map.
  */
 void Execute(int r, int c, int type);
 
-namespace ClientNS {
+/**
+ * @brief The definition of function ExecuteBatch(const std::vector<Operation> &)
+ *
+ * @details This function takes several steps in one round trip: the operations are executed in order like Execute(),
+ * stopping after the first one that ends the game, and the client then reads one observation of all their changes
+ * instead of one per operation. The game is the same as calling Execute() for every operation.
+ */
+void ExecuteBatch(const std::vector<Operation> &ops);
 
-    const int dx[] = {0, 0, 1, -1, 1, -1, 1, -1};
-    const int dy[] = {1, -1, 0, 0, 1, -1, -1, 1};
+namespace ClientNS {
 
+    /**
+     * @brief The player of one game.
+     *
+     * @details The size of the map and the random generator used for guessing belong to the instance, so several
+     * clients can play at the same time. The global functions below operate on getClientInstance().
+     */
     class Client {
     private:
-        int map[35][35];  // -1 - unknown, -2 - marked, 0-8 - number of mines 
-        int marked_count[35][35];
-        int unknown_count[35][35];
+        int rows;
+        int columns;
+        int total_mines;
+        std::mt19937 rng;  // Used for guessing, see Seed()
+        // The map (-1 - unknown, -2 - marked, 0-8 - number of mines) and the unknown and marked neighbours of every
+        // block. Lookahead can change it hypothetically and restore it, see KnowledgeState.
+        KnowledgeState knowledge;
+
+        // operatoration queue - (row-major index r * columns + c, type)
+        std::queue<std::pair<int, int>> op_queue;
+        // The blocks queued to be marked. The border is set, so that DetectBlock() never looks beyond the map.
+        PaddedGrid<bool> marked;
+        std::array<int, 8> block_offsets;  // NeighbourOffsets() of the row-major indices
+
+        // Whether deduction only looks at the dirty blocks, see SetIncremental().
+        bool incremental = false;
+        // The blocks that changed, or have a neighbour that changed, since the last deduction (row-major indices). The
+        // border of dirty is set, so that SetBlock() never adds a block beyond the map.
+        PaddedGrid<bool> dirty;
+        std::vector<int> dirty_list;
+
+        // Used when the simple rules find nothing, see NextOperation().
+        GaussianDeducer deducer;
+        std::vector<int> deducer_changes;  // The blocks changed since the last GaussianDetect()
+        FrontierSolver solver;
+        CellChanges delta;  // The buffer of ReadChanges()
+        std::vector<Operation> pending;  // The buffer of Decide()
+
+        // Set the content of block (r, c) and update the counters of its neighbours by delta.
+        void SetBlock(int r, int c, int value) {
+            knowledge.Set(r, c, value);
+            if (solver.Options().gaussian) {
+                deducer_changes.push_back(r * columns + c);
+            }
+            int index = dirty.Index(r, c);
+            int block = r * columns + c;
+            if (!dirty.At(index)) {
+                dirty.At(index) = true;
+                dirty_list.push_back(block);
+            }
+            for (int k = 0; k < 8; ++k) {
+                if (!dirty.At(index + dirty.Offsets()[k])) {
+                    dirty.At(index + dirty.Offsets()[k]) = true;
+                    dirty_list.push_back(block + block_offsets[k]);
+                }
+            }
+        }
 
-        // operatoration queue - (pos, type)
-        std::queue<std::pair<std::pair<int, int>, int>> op_queue;
-        bool marked[35][35];
+        void ClearDirty() {
+            for (int block : dirty_list) {
+                dirty.At(dirty.BlockIndex(block)) = false;
+            }
+            dirty_list.clear();
+        }
 
     public:
         Client() {
-            Reset();
+            Reset(0, 0, 0);
         }
 
-        void Reset() {
-            memset(map, 0, sizeof(map));
-            memset(marked_count, 0, sizeof(marked_count));
-            memset(unknown_count, 0, sizeof(unknown_count));
-            memset(marked, 0, sizeof(marked));
+        void Reset(int r, int c, int mines) {
+            rows = r;
+            columns = c;
+            total_mines = mines;
+            knowledge.Reset(rows, columns);
+            marked.Assign(rows, columns, false, true);
+            block_offsets = NeighbourOffsets(columns);
+            dirty.Assign(rows, columns, false, true);
+            dirty_list.clear();
+            deducer.Reset(rows, columns);
+            deducer_changes.clear();
             while (!op_queue.empty()) {
                 op_queue.pop();
             }
         }
 
+        /**
+         * What the client knows about the map. Lookahead may change it between Snapshot() and Restore(), as long as
+         * it is restored before the next call of the client.
+         */
+        KnowledgeState &Knowledge() {
+            return knowledge;
+        }
+
+        /**
+         * Seed the random generator used for guessing. Games played by clients with the same seed on the same map
+         * are identical.
+         */
+        void Seed(unsigned seed) {
+            rng.seed(seed);
+            solver.Seed(seed);
+        }
+
         void InitGame() {
             int first_row, first_column;
             std::cin >> first_row >> first_column;
             Execute(first_row, first_column, 0);
         }
 
-        void ReadMap() {
-            memset(marked_count, 0, sizeof(marked_count));
-            memset(unknown_count, 0, sizeof(unknown_count));
+        /**
+         * Read the whole map printed by PrintMap(). Only the blocks that differ from the current map are applied, so
+         * the counters are updated by delta just like in Observe().
+         */
+        void ReadMap(std::istream &in = std::cin) {
             for (int i = 0; i < rows; ++i) {
                 for (int j = 0; j < columns; ++j) {
                     char c;
-                    std::cin >> c;
+                    in >> c;
+                    int value;
                     if (c == '?') {
                         // The block is unknown.
-                        map[i][j] = -1;
-                        for (int k = 0; k < 8; ++k) {
-                            int x = i + dx[k];
-                            int y = j + dy[k];
-                            if (x >= 0 && x < rows && y >= 0 && y < columns) {
-                                ++unknown_count[x][y];
-                            }
-                        }
+                        value = -1;
                     } else if (c == '@') {
                         // The block has been marked as a mine.
-                        map[i][j] = -2;
-                        for (int k = 0; k < 8; ++k) {
-                            int x = i + dx[k];
-                            int y = j + dy[k];
-                            if (x >= 0 && x < rows && y >= 0 && y < columns) {
-                                ++marked_count[x][y];
-                            }
-                        }
+                        value = -2;
                     } else {
                         // The block has been visited.
-                        map[i][j] = c - '0';
+                        value = c - '0';
+                    }
+                    if (knowledge.Map()[i][j] != value) {
+                        SetBlock(i, j, value);
                     }
                 }
             }
         }
 
+        /**
+         * Apply the blocks changed by the last operation. This leaves the client in the same state as ReadMap() on
+         * the full map, but only costs time proportional to the number of changed blocks.
+         */
+        void Observe(const CellChanges &changes) {
+            for (const CellChange &change : changes) {
+                SetBlock(change.row, change.column, change.value);
+            }
+        }
+
+        /**
+         * Read one delta output of PrintChanges() (see FormatChanges()) and apply it like Observe(). Returns the game
+         * state it carries, or 0 if the input ends or is malformed (nothing is applied then).
+         */
+        int ReadChanges(std::istream &in = std::cin) {
+            int game_state = 0;
+            if (!ParseChanges(in, delta, game_state, rows, columns)) {
+                return 0;
+            }
+            Observe(delta);
+            return game_state;
+        }
+
+        /**
+         * Choose whether deduction rescans the whole map (SimpleDetect()) or only the blocks around the blocks changed
+         * since the last deduction (IncrementalDetect()). Both queue exactly the same operations (`bench incremental`
+         * checks them in lockstep). The rescan is the default: the rules are cheap next to the solver, and the worklist
+         * has not been faster on the batch configurations so far.
+         */
+        void SetIncremental(bool value) {
+            incremental = value;
+        }
+
+        // Queue the operations the rules of SimpleDetect() find around block (i, j).
+        void DetectBlock(int i, int j) {
+            const Grid<signed char> &map = knowledge.Map();
+            int block = i * columns + j;
+            int value = map.At(block);
+            if (value <= 0) {
+                return;
+            }
+            int marked_count = knowledge.MarkedCount(i, j);
+            int unknown_count = knowledge.UnknownCount(i, j);
+            if (marked_count + unknown_count == value) {
+                // The border of marked stops the loop, so block + block_offsets[k] is only read inside the map.
+                int index = marked.Index(i, j);
+                for (int k = 0; k < 8; ++k) {
+                    int next = index + marked.Offsets()[k];
+                    if (!marked.At(next) && map.At(block + block_offsets[k]) == -1) {
+                        op_queue.push({block + block_offsets[k], 1});
+                        marked.At(next) = true;
+                    }
+                }
+            }
+            if (marked_count == value && unknown_count > 0) {
+                op_queue.push({block, 2});
+            }
+        }
+
         void SimpleDetect() {
             for (int i = 0; i < rows; ++i) {
                 for (int j = 0; j < columns; ++j) {
-                    if (map[i][j] > 0 && marked_count[i][j] + unknown_count[i][j] == map[i][j]) {
-                        for (int k = 0; k < 8; ++k) {
-                            int x = i + dx[k];
-                            int y = j + dy[k];
-                            if (x >= 0 && x < rows && y >= 0 && y < columns &&
-                                !marked[x][y] && map[x][y] == -1) {
-                                op_queue.push({{x, y}, 1});
-                                marked[x][y] = true;
-                            }
-                        }
-                    }
-                    if (map[i][j] > 0 && marked_count[i][j] == map[i][j] && unknown_count[i][j] > 0) {
-                        op_queue.push({{i, j}, 2});
+                    DetectBlock(i, j);
+                }
+            }
+            ClearDirty();
+        }
+
+        /**
+         * The same as SimpleDetect(), but only looks at the dirty blocks, in the same (row-major) order.
+         *
+         * @note A block only satisfies a rule if it or one of its neighbours changed since the last deduction: when a
+         * rule fires, the queued operations mark or visit all of its unknown neighbours before the next deduction
+         * (deduction only runs once op_queue is empty), so it does not fire again until its neighbourhood changes.
+         */
+        void IncrementalDetect() {
+            std::sort(dirty_list.begin(), dirty_list.end());
+            for (int block : dirty_list) {
+                DetectBlock(block / columns, block % columns);
+            }
+            ClearDirty();
+        }
+
+        void SetSolverOptions(const SolverOptions &options) {
+            if (options.gaussian && !solver.Options().gaussian) {
+                // The deducer missed the changes so far: give it every known block.
+                deducer.Reset(rows, columns);
+                deducer_changes.clear();
+                for (int block = 0; block < rows * columns; ++block) {
+                    if (knowledge.Map().At(block) != -1) {
+                        deducer_changes.push_back(block);
                     }
                 }
             }
+            solver.SetOptions(options);
         }
 
-        void Decide() {
+        /**
+         * Queue the blocks GaussianDeducer proves safe (to visit) or mines (to mark) from the equations of all the
+         * visited blocks together.
+         */
+        void GaussianDetect() {
+            deducer.Update(knowledge.Map(), deducer_changes);
+            deducer_changes.clear();
+            for (int block : deducer.SafeBlocks()) {
+                if (knowledge.Map().At(block) == -1) {
+                    op_queue.push({block, 0});
+                }
+            }
+            for (int block : deducer.MineBlocks()) {
+                if (!marked.At(marked.BlockIndex(block))) {
+                    op_queue.push({block, 1});
+                    marked.At(marked.BlockIndex(block)) = true;
+                }
+            }
+        }
+
+        /**
+         * Queue the blocks the frontier solver proves safe (to visit) or mines (to mark). Returns the least risky
+         * unknown block to visit if there is none, or -1 if there are.
+         */
+        int SolverDetect() {
+            solver.Solve(knowledge.Map(), total_mines);
+            for (int block : solver.SafeBlocks()) {
+                op_queue.push({block, 0});
+            }
+            for (int block : solver.MineBlocks()) {
+                if (!marked.At(marked.BlockIndex(block))) {
+                    op_queue.push({block, 1});
+                    marked.At(marked.BlockIndex(block)) = true;
+                }
+            }
+            return op_queue.empty() ? solver.BestGuess(rng) : -1;
+        }
+
+        Operation NextOperation() {
+            int guess = -1;
+            METRICS_ADD(kDecisions, 1);
             if (op_queue.empty()) {
-                SimpleDetect();
+                METRICS_PHASE(kDetect);
+                if (incremental) {
+                    IncrementalDetect();
+                } else {
+                    SimpleDetect();
+                }
+                METRICS_ADD(kRuleDeductions, op_queue.size());
             }
+            if (op_queue.empty() && solver.Options().gaussian) {
+                METRICS_PHASE(kGaussian);
+                GaussianDetect();
+                METRICS_ADD(kGaussDeductions, op_queue.size());
+            }
+            if (op_queue.empty() && solver.Options().enabled) {
+                METRICS_PHASE(kSolver);
+                guess = SolverDetect();
+                METRICS_ADD(kSolverDeductions, op_queue.size());
+            }
+            METRICS_ADD(kQueueDepth, op_queue.size());
+            METRICS_MAX(kMaxQueueDepth, op_queue.size());
+            METRICS_GUESS(op_queue.empty());
             if (!op_queue.empty()) {
                 auto front = op_queue.front();
                 op_queue.pop();
-                int r = front.first.first;
-                int c = front.first.second;
-                int type = front.second;
-                Execute(r, c, type);
+                return {front.first / columns, front.first % columns, front.second};
+            } else if (guess >= 0) {
+                METRICS_ADD(kSolverGuesses, 1);
+                return {guess / columns, guess % columns, 0};
             } else {
+                METRICS_ADD(kRandomGuesses, 1);
                 int x, y;
                 do {
-                    x = rand() % rows;
-                    y = rand() % columns;
-                } while (map[x][y] != -1);
-                Execute(x, y, 0);
+                    x = rng() % rows;
+                    y = rng() % columns;
+                } while (knowledge.Map()[x][y] != -1);
+                return {x, y, 0};
+            }
+        }
+
+        /**
+         * The operations up to the next decision that depends on their result: NextOperation(), then the certain
+         * operations queued with it. Nothing is deduced until the queue is empty anyway, so executing them in one batch
+         * leads to the same game as deciding and observing them one at a time.
+         */
+        void NextOperations(std::vector<Operation> &ops) {
+            ops.clear();
+            do {
+                ops.push_back(NextOperation());
+            } while (!op_queue.empty());
+        }
+
+        void Decide() {
+            NextOperations(pending);
+            if (pending.size() == 1) {
+                Execute(pending[0].row, pending[0].column, pending[0].type);
+            } else {
+                ExecuteBatch(pending);
             }
         }
 
@@ -157,7 +398,7 @@ inline ClientNS::Client& getClientInstance() {
  * will read the scale of the game map and the first step taken by the server (see README).
  */
 void InitGame() {
-    getClientInstance().Reset();
+    getClientInstance().Reset(rows, columns, total_mines);
     getClientInstance().InitGame();
 }
 
@@ -175,6 +416,26 @@ void ReadMap() {
     getClientInstance().ReadMap();
 }
 
+/**
+ * @brief The definition of function Observe(const CellChanges &)
+ *
+ * @details This function is the typed alternative to ReadMap(). Instead of parsing the whole map from stdin, it
+ * applies the list of blocks changed by the last operation (see GetChanges() in server.h).
+ */
+void Observe(const CellChanges &changes) {
+    getClientInstance().Observe(changes);
+}
+
+/**
+ * @brief The definition of function ReadChanges()
+ *
+ * @details This function reads the output of PrintChanges() (see server.h) from stdin: instead of the whole map, only
+ * the blocks changed by the last operation, which are applied to the client's map like Observe() does.
+ */
+void ReadChanges() {
+    getClientInstance().ReadChanges();
+}
+
 /**
  * @brief The definition of function Decide()
  *
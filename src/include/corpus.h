@@ -0,0 +1,309 @@
+/**
+ * This header file implements the binary board corpus: a file of many boards that can be read without parsing.
+ *
+ * A corpus file is little-endian and consists of
+ *   CorpusHeader                        the magic "MSCORPUS", the version, the number of boards and the index offset
+ *   a record for every board            CorpusBoardHeader (size, mine count, first step, seed and index of the run),
+ *                                       then the mines packed as in BoardArena: (rows * columns + 63) / 64 words with
+ *                                       bit r * columns + c set for a mine
+ *   the index                           the offset of every record, as uint64_t
+ * Every part starts at a multiple of 8 bytes, so CorpusReader maps the file with mmap() and hands out pointers to the
+ * mine words in place: a game loads its map with InitMap(const uint64_t *) without any copy.
+ *
+ * The seed and index of a record are the ones the board was generated from (0 for boards converted from text). The
+ * batch evaluator seeds the client of a corpus board with ClientSeed(seed, index), so a corpus generated from a batch
+ * replays exactly the games of that batch.
+ */
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct CorpusHeader {
+  char magic[8];  // "MSCORPUS"
+  uint32_t version;
+  uint32_t header_size;  // sizeof(CorpusHeader)
+  uint64_t board_count;
+  uint64_t index_offset;  // Where the index starts, 0 while the file is being written
+};
+
+struct CorpusBoardHeader {
+  uint32_t rows;
+  uint32_t columns;
+  uint32_t mine_count;
+  int32_t first_row;
+  int32_t first_column;
+  uint32_t reserved;
+  uint64_t seed;
+  uint64_t index;
+};
+
+const char kCorpusMagic[8] = {'M', 'S', 'C', 'O', 'R', 'P', 'U', 'S'};
+const uint32_t kCorpusVersion = 1;
+
+/**
+ * One board of a corpus. mines points into the mapped file (or into the caller's buffer when writing).
+ */
+struct CorpusBoard {
+  int rows = 0;
+  int columns = 0;
+  int mine_count = 0;
+  int first_row = 0;
+  int first_column = 0;
+  uint64_t seed = 0;
+  uint64_t index = 0;
+  const uint64_t *mines = nullptr;
+
+  bool IsMine(int r, int c) const {
+    size_t block = static_cast<size_t>(r) * columns + c;
+    return (mines[block >> 6] >> (block & 63)) & 1;
+  }
+};
+
+inline size_t CorpusWords(int rows, int columns) { return (static_cast<size_t>(rows) * columns + 63) / 64; }
+
+// Whether a board of this size and first step can be played: at least one block, and the first step on the board.
+inline bool CorpusBoardValid(int64_t rows, int64_t columns, int64_t first_row, int64_t first_column) {
+  return rows >= 1 && columns >= 1 && rows <= INT32_MAX && columns <= INT32_MAX && first_row >= 0 &&
+         first_row < rows && first_column >= 0 && first_column < columns;
+}
+
+/**
+ * Write a corpus file board by board. The index and the board count are written by Close().
+ */
+class CorpusWriter {
+ public:
+  CorpusWriter() : file_(nullptr), offset_(0), ok_(true) {}
+  ~CorpusWriter() { Close(); }
+
+  bool Open(const std::string &path) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      return false;
+    }
+    CorpusHeader header = {};
+    std::memcpy(header.magic, kCorpusMagic, sizeof(header.magic));
+    header.version = kCorpusVersion;
+    header.header_size = sizeof(CorpusHeader);
+    offset_ = 0;
+    offsets_.clear();
+    ok_ = Write(&header, sizeof(header));
+    return ok_;
+  }
+
+  // Append a board. The mine count is counted from board.mines. Returns false if it could not be written.
+  bool Add(const CorpusBoard &board) {
+    CorpusBoardHeader header = {};
+    header.rows = board.rows;
+    header.columns = board.columns;
+    header.first_row = board.first_row;
+    header.first_column = board.first_column;
+    header.seed = board.seed;
+    header.index = board.index;
+    size_t words = CorpusWords(board.rows, board.columns);
+    for (size_t w = 0; w < words; ++w) {
+      header.mine_count += __builtin_popcountll(board.mines[w]);
+    }
+    offsets_.push_back(offset_);
+    bool ok = Write(&header, sizeof(header)) && Write(board.mines, words * sizeof(uint64_t));
+    ok_ = ok && ok_;
+    return ok;
+  }
+
+  int Size() const { return static_cast<int>(offsets_.size()); }
+
+  // Write the index and the header. Returns false if anything (including a board of Add()) could not be written.
+  bool Close() {
+    if (file_ == nullptr) {
+      return false;
+    }
+    CorpusHeader header = {};
+    std::memcpy(header.magic, kCorpusMagic, sizeof(header.magic));
+    header.version = kCorpusVersion;
+    header.header_size = sizeof(CorpusHeader);
+    header.board_count = offsets_.size();
+    header.index_offset = offset_;
+    bool ok = ok_ && Write(offsets_.data(), offsets_.size() * sizeof(uint64_t));
+    ok = ok && std::fseek(file_, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file_) == 1;
+    ok = std::fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    return ok;
+  }
+
+ private:
+  bool Write(const void *data, size_t size) {
+    offset_ += size;
+    return size == 0 || std::fwrite(data, size, 1, file_) == 1;
+  }
+
+  std::FILE *file_;
+  uint64_t offset_;
+  bool ok_;  // False once a write failed
+  std::vector<uint64_t> offsets_;
+};
+
+/**
+ * Read a corpus file mapped into memory. Boards can be accessed in any order and from any thread.
+ */
+class CorpusReader {
+ public:
+  CorpusReader() : data_(nullptr), size_(0), header_(nullptr), index_(nullptr) {}
+  ~CorpusReader() { Close(); }
+  CorpusReader(const CorpusReader &) = delete;
+  CorpusReader &operator=(const CorpusReader &) = delete;
+
+  /**
+   * Map the file at path. Returns false (and writes the reason to error if given) if it cannot be read or is not a
+   * valid corpus.
+   */
+  bool Open(const std::string &path, std::string *error = nullptr) {
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return Fail(error, "cannot open " + path);
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(CorpusHeader))) {
+      ::close(fd);
+      return Fail(error, path + " is too small to be a corpus");
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      size_ = 0;
+      return Fail(error, "cannot map " + path);
+    }
+    data_ = static_cast<const unsigned char *>(data);
+    header_ = reinterpret_cast<const CorpusHeader *>(data_);
+    if (std::memcmp(header_->magic, kCorpusMagic, sizeof(kCorpusMagic)) != 0 || header_->version != kCorpusVersion ||
+        header_->header_size != sizeof(CorpusHeader)) {
+      Close();
+      return Fail(error, path + " is not a corpus of version " + std::to_string(kCorpusVersion));
+    }
+    if (header_->index_offset % 8 != 0 || header_->index_offset > size_ ||
+        (size_ - header_->index_offset) / sizeof(uint64_t) < header_->board_count) {
+      Close();
+      return Fail(error, path + " is truncated");
+    }
+    index_ = reinterpret_cast<const uint64_t *>(data_ + header_->index_offset);
+    for (uint64_t i = 0; i < header_->board_count; ++i) {
+      if (index_[i] % 8 != 0 || index_[i] + sizeof(CorpusBoardHeader) > header_->index_offset) {
+        Close();
+        return Fail(error, path + " has a bad index");
+      }
+      const CorpusBoardHeader *board = reinterpret_cast<const CorpusBoardHeader *>(data_ + index_[i]);
+      if (!CorpusBoardValid(board->rows, board->columns, board->first_row, board->first_column) ||
+          index_[i] + sizeof(CorpusBoardHeader) + CorpusWords(board->rows, board->columns) * sizeof(uint64_t) >
+          header_->index_offset) {
+        Close();
+        return Fail(error, path + " has a bad board " + std::to_string(i));
+      }
+    }
+    // Tell the kernel the boards are usually read in order.
+    ::madvise(const_cast<unsigned char *>(data_), size_, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  void Close() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<unsigned char *>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    header_ = nullptr;
+    index_ = nullptr;
+  }
+
+  int Size() const { return header_ == nullptr ? 0 : static_cast<int>(header_->board_count); }
+
+  CorpusBoard Board(int i) const {
+    const CorpusBoardHeader *header = reinterpret_cast<const CorpusBoardHeader *>(data_ + index_[i]);
+    CorpusBoard board;
+    board.rows = static_cast<int>(header->rows);
+    board.columns = static_cast<int>(header->columns);
+    board.mine_count = static_cast<int>(header->mine_count);
+    board.first_row = header->first_row;
+    board.first_column = header->first_column;
+    board.seed = header->seed;
+    board.index = header->index;
+    board.mines = reinterpret_cast<const uint64_t *>(header + 1);
+    return board;
+  }
+
+ private:
+  static bool Fail(std::string *error, const std::string &message) {
+    if (error != nullptr) {
+      *error = message;
+    }
+    return false;
+  }
+
+  const unsigned char *data_;
+  size_t size_;
+  const CorpusHeader *header_;
+  const uint64_t *index_;
+};
+
+/**
+ * Read a board in the text format of GenerateMap() and testcases/advanced/adv*.in (size, map, first step) into board,
+ * with its mines in words. Returns false at the end of the input, or with only the failbit of in set (not eofbit) if
+ * the board is truncated, too small or its first step is outside of it.
+ */
+inline bool ReadTextBoard(std::istream &in, CorpusBoard &board, std::vector<uint64_t> &words) {
+  if (!(in >> board.rows >> board.columns)) {
+    return false;
+  }
+  if (!CorpusBoardValid(board.rows, board.columns, 0, 0)) {
+    in.clear(std::ios::failbit);
+    return false;
+  }
+  words.assign(CorpusWords(board.rows, board.columns), 0);
+  board.mine_count = 0;
+  for (int i = 0; i < board.rows; ++i) {
+    for (int j = 0; j < board.columns; ++j) {
+      char ch;
+      in >> ch;
+      if (ch == 'X') {
+        size_t block = static_cast<size_t>(i) * board.columns + j;
+        words[block >> 6] |= 1ULL << (block & 63);
+        ++board.mine_count;
+      }
+    }
+  }
+  board.mines = words.data();
+  if (!(in >> board.first_row >> board.first_column) ||
+      !CorpusBoardValid(board.rows, board.columns, board.first_row, board.first_column)) {
+    in.clear(std::ios::failbit);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Print a board in the text format read by ReadTextBoard() and InitMap().
+ */
+inline void WriteTextBoard(std::ostream &out, const CorpusBoard &board) {
+  std::string line;
+  out << board.rows << " " << board.columns << "\n";
+  for (int i = 0; i < board.rows; ++i) {
+    line.clear();
+    for (int j = 0; j < board.columns; ++j) {
+      line += board.IsMine(i, j) ? 'X' : '.';
+    }
+    out << line << "\n";
+  }
+  out << board.first_row << " " << board.first_column << "\n";
+}
+
+#endif
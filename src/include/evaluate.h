@@ -0,0 +1,246 @@
+/**
+ * This header file implements the paired sequential evaluator used by `client --evaluate`.
+ *
+ * A baseline and a candidate client (two sets of SolverOptions) play the same games of a batch: game i has the same map
+ * and the same client seed for both, so the comparison is paired and the noise of the maps cancels out. Only the
+ * discordant pairs, where exactly one of the two wins, tell the clients apart. With q the probability that the
+ * candidate wins a discordant pair, a sequential probability ratio test (SPRT) decides between H0: q = 0.5 - delta
+ * (the candidate is not better) and H1: q = 0.5 + delta (it is better) with error rates alpha and beta, after as few
+ * games as the data allows. Optionally the run also stops once the Wilson intervals of both win rates are narrow
+ * enough, and after max_games at most.
+ *
+ * Games are played in chunks by RunBatch(), but the stopping rules are checked game by game in the order of the run,
+ * so the result does not depend on the chunk size or the number of threads.
+ */
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "batch.h"
+
+struct Interval {
+  double low = 0;
+  double high = 1;
+
+  double Width() const { return high - low; }
+};
+
+/**
+ * The quantile of the standard normal distribution at p (0 < p < 1), by bisection on erfc().
+ */
+inline double NormalQuantile(double p) {
+  double low = -40;
+  double high = 40;
+  for (int i = 0; i < 200; ++i) {
+    double middle = (low + high) / 2;
+    if (0.5 * std::erfc(-middle / std::sqrt(2.0)) < p) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return (low + high) / 2;
+}
+
+/**
+ * The Wilson score interval of a win rate, where z = NormalQuantile(1 - alpha / 2) for confidence 1 - alpha.
+ */
+inline Interval WilsonInterval(long long wins, long long games, double z) {
+  Interval interval;
+  if (games == 0) {
+    return interval;
+  }
+  double n = static_cast<double>(games);
+  double p = wins / n;
+  double center = (p + z * z / (2 * n)) / (1 + z * z / n);
+  double half = z / (1 + z * z / n) * std::sqrt(p * (1 - p) / n + z * z / (4 * n * n));
+  interval.low = std::max(0.0, center - half);
+  interval.high = std::min(1.0, center + half);
+  return interval;
+}
+
+/**
+ * The regularized incomplete beta function I_x(a, b), by the continued fraction of Numerical Recipes (Lentz's method).
+ */
+inline double RegularizedBeta(double a, double b, double x) {
+  if (x <= 0) {
+    return 0;
+  }
+  if (x >= 1) {
+    return 1;
+  }
+  if (x > (a + 1) / (a + b + 2)) {
+    // The continued fraction converges fast on this side only.
+    return 1 - RegularizedBeta(b, a, 1 - x);
+  }
+  const double kTiny = 1e-300;
+  double log_front = std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log1p(-x);
+  double front = std::exp(log_front) / a;
+  double c = 1;
+  double d = 1 - (a + b) * x / (a + 1);
+  d = 1 / (std::fabs(d) < kTiny ? kTiny : d);
+  double result = d;
+  for (int m = 1; m <= 10000; ++m) {
+    for (int step = 0; step < 2; ++step) {
+      double numerator = step == 0 ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+                                   : -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+      d = 1 + numerator * d;
+      d = 1 / (std::fabs(d) < kTiny ? kTiny : d);
+      c = 1 + numerator / c;
+      c = std::fabs(c) < kTiny ? kTiny : c;
+      result *= c * d;
+    }
+    if (std::fabs(c * d - 1) < 1e-15) {
+      break;
+    }
+  }
+  return front * result;
+}
+
+// The x with I_x(a, b) = p, by bisection.
+inline double BetaQuantile(double p, double a, double b) {
+  double low = 0;
+  double high = 1;
+  for (int i = 0; i < 100; ++i) {
+    double middle = (low + high) / 2;
+    if (RegularizedBeta(a, b, middle) < p) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return (low + high) / 2;
+}
+
+/**
+ * The exact (Clopper-Pearson) interval of a win rate with confidence 1 - alpha.
+ */
+inline Interval ClopperPearsonInterval(long long wins, long long games, double alpha) {
+  Interval interval;
+  if (games == 0) {
+    return interval;
+  }
+  double k = static_cast<double>(wins);
+  double n = static_cast<double>(games);
+  interval.low = wins == 0 ? 0 : BetaQuantile(alpha / 2, k, n - k + 1);
+  interval.high = wins == games ? 1 : BetaQuantile(1 - alpha / 2, k + 1, n - k);
+  return interval;
+}
+
+/**
+ * The SPRT on the discordant pairs: H0 q = 0.5 - delta against H1 q = 0.5 + delta, q the probability that the
+ * candidate wins a discordant pair.
+ */
+class PairedSprt {
+ public:
+  PairedSprt(double alpha, double beta, double delta)
+      : lower_(std::log(beta / (1 - alpha))),
+        upper_(std::log((1 - beta) / alpha)),
+        win_step_(std::log((0.5 + delta) / (0.5 - delta))),
+        llr_(0) {}
+
+  void Add(bool baseline_won, bool candidate_won) {
+    if (baseline_won != candidate_won) {
+      llr_ += candidate_won ? win_step_ : -win_step_;
+    }
+  }
+
+  // 1 if H1 is accepted (the candidate is better), -1 if H0 is accepted, 0 while undecided.
+  int Decision() const { return llr_ >= upper_ ? 1 : llr_ <= lower_ ? -1 : 0; }
+
+  double Llr() const { return llr_; }
+  double LowerBound() const { return lower_; }
+  double UpperBound() const { return upper_; }
+
+ private:
+  double lower_;
+  double upper_;
+  double win_step_;  // The log-likelihood ratio of a discordant pair won by the candidate (minus it if lost)
+  double llr_;
+};
+
+struct EvaluationConfig {
+  BatchConfig batch;  // The maps, the threads and the options of the baseline
+  ClientNS::SolverOptions candidate;
+  int max_games = 200000;
+  double alpha = 0.05;  // The false positive rate of the SPRT; the intervals have confidence 1 - alpha
+  double beta = 0.05;   // The false negative rate of the SPRT
+  double delta = 0.1;   // See PairedSprt
+  double width = 0;     // Stop once both Wilson intervals are at most this wide, 0 to rely on the SPRT only
+};
+
+enum class StopReason { kSprt, kWidth, kMaxGames };
+
+struct EvaluationResult {
+  long long games = 0;      // The games counted, up to the one that met a stopping rule
+  long long games_run = 0;  // The games played, including the rest of the last chunk
+  long long baseline_wins = 0;
+  long long candidate_wins = 0;
+  long long candidate_only = 0;  // Discordant pairs won by the candidate
+  long long baseline_only = 0;   // Discordant pairs won by the baseline
+  int decision = 0;              // PairedSprt::Decision() when the run stopped
+  StopReason reason = StopReason::kMaxGames;
+  double llr = 0;
+  double llr_lower = 0;
+  double llr_upper = 0;
+  double baseline_seconds = 0;
+  double candidate_seconds = 0;
+};
+
+/**
+ * Play games first_game, first_game + 1, ... of config.batch with the baseline and the candidate until a stopping
+ * rule is met.
+ */
+inline EvaluationResult Evaluate(const EvaluationConfig &config) {
+  using Clock = std::chrono::steady_clock;
+  const int kFirstChunk = 256;
+  const int kMaxChunk = 1 << 14;
+  BatchConfig baseline = config.batch;
+  BatchConfig candidate = config.batch;
+  candidate.solver = config.candidate;
+  PairedSprt sprt(config.alpha, config.beta, config.delta);
+  double z = NormalQuantile(1 - config.alpha / 2);
+  EvaluationResult result;
+  bool stopped = false;
+  for (int chunk = kFirstChunk; !stopped && result.games < config.max_games; chunk = std::min(chunk * 2, kMaxChunk)) {
+    baseline.first_game = candidate.first_game = config.batch.first_game + static_cast<int>(result.games);
+    baseline.games = candidate.games = static_cast<int>(std::min<long long>(chunk, config.max_games - result.games));
+    auto start = Clock::now();
+    std::vector<GameResult> baseline_results = RunBatch(baseline);
+    auto middle = Clock::now();
+    std::vector<GameResult> candidate_results = RunBatch(candidate);
+    result.baseline_seconds += std::chrono::duration<double>(middle - start).count();
+    result.candidate_seconds += std::chrono::duration<double>(Clock::now() - middle).count();
+    result.games_run += baseline.games;
+    for (int i = 0; i < baseline.games && !stopped; ++i) {
+      bool baseline_won = baseline_results[i].game_state == 1;
+      bool candidate_won = candidate_results[i].game_state == 1;
+      ++result.games;
+      result.baseline_wins += baseline_won;
+      result.candidate_wins += candidate_won;
+      result.candidate_only += candidate_won && !baseline_won;
+      result.baseline_only += baseline_won && !candidate_won;
+      sprt.Add(baseline_won, candidate_won);
+      if (sprt.Decision() != 0) {
+        result.reason = StopReason::kSprt;
+        stopped = true;
+      } else if (config.width > 0 &&
+                 WilsonInterval(result.baseline_wins, result.games, z).Width() <= config.width &&
+                 WilsonInterval(result.candidate_wins, result.games, z).Width() <= config.width) {
+        result.reason = StopReason::kWidth;
+        stopped = true;
+      }
+    }
+  }
+  result.decision = sprt.Decision();
+  result.llr = sprt.Llr();
+  result.llr_lower = sprt.LowerBound();
+  result.llr_upper = sprt.UpperBound();
+  return result;
+}
+
+#endif
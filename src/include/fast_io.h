@@ -0,0 +1,171 @@
+/**
+ * This header file implements the buffered input and output of `server --fast`: FastReader parses integers and
+ * characters from large read(2) blocks, and FastWriter collects the output of an operation and writes it with a single
+ * write(2) when flushed. Neither goes through iostreams, so they should not be mixed with std::cin or std::cout on the
+ * same file descriptor. Both also pass raw bytes, for the binary frames of the referee (referee.h).
+ */
+#ifndef FAST_IO_H
+#define FAST_IO_H
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+class FastReader {
+ public:
+  explicit FastReader(int fd = 0) : fd_(fd), begin_(0), end_(0) {}
+  FastReader(const FastReader &) = delete;
+  FastReader &operator=(const FastReader &) = delete;
+
+  // Read the next character that is not whitespace. Returns false at the end of the input.
+  bool ReadChar(char &ch) {
+    int next = SkipSpaces();
+    if (next < 0) {
+      return false;
+    }
+    ch = static_cast<char>(next);
+    ++begin_;
+    return true;
+  }
+
+  // Read the next (optionally negative) decimal integer. Returns false at the end of the input or if there is none.
+  bool ReadInt(int &value) {
+    int next = SkipSpaces();
+    bool negative = next == '-';
+    if (negative) {
+      ++begin_;
+      next = Peek();
+    }
+    if (next < '0' || next > '9') {
+      return false;
+    }
+    int result = 0;
+    while (next >= '0' && next <= '9') {
+      result = result * 10 + (next - '0');
+      ++begin_;
+      next = Peek();
+    }
+    value = negative ? -result : result;
+    return true;
+  }
+
+  // Read the next run of characters that are not whitespace into word. Returns false at the end of the input.
+  bool ReadWord(std::string &word) {
+    int next = SkipSpaces();
+    word.clear();
+    while (next >= 0 && next != ' ' && next != '\n' && next != '\r' && next != '\t') {
+      word += static_cast<char>(next);
+      ++begin_;
+      next = Peek();
+    }
+    return !word.empty();
+  }
+
+  // Read exactly size bytes into data. Returns false if the input ends before.
+  bool ReadBytes(void *data, size_t size) {
+    char *out = static_cast<char *>(data);
+    while (size > 0) {
+      if (begin_ == end_ && !Fill()) {
+        return false;
+      }
+      size_t count = std::min(size, end_ - begin_);
+      std::memcpy(out, buffer_ + begin_, count);
+      begin_ += count;
+      out += count;
+      size -= count;
+    }
+    return true;
+  }
+
+  // The number of bytes read from the file descriptor but not consumed yet: the next read only blocks if this is 0.
+  size_t Buffered() const { return end_ - begin_; }
+
+  /**
+   * Consume the whitespace already read, without reading more, so that Buffered() is 0 if only the line break after a
+   * text request is left (the next read would block).
+   */
+  void SkipBufferedSpaces() {
+    while (begin_ < end_ && (buffer_[begin_] == ' ' || buffer_[begin_] == '\n' || buffer_[begin_] == '\r' ||
+                             buffer_[begin_] == '\t')) {
+      ++begin_;
+    }
+  }
+
+ private:
+  // The next character without consuming it, or -1 at the end of the input.
+  int Peek() {
+    if (begin_ == end_ && !Fill()) {
+      return -1;
+    }
+    return static_cast<unsigned char>(buffer_[begin_]);
+  }
+
+  int SkipSpaces() {
+    int next = Peek();
+    while (next == ' ' || next == '\n' || next == '\r' || next == '\t') {
+      ++begin_;
+      next = Peek();
+    }
+    return next;
+  }
+
+  bool Fill() {
+    ssize_t size;
+    do {
+      size = ::read(fd_, buffer_, sizeof(buffer_));
+    } while (size < 0 && errno == EINTR);
+    begin_ = 0;
+    end_ = size > 0 ? static_cast<size_t>(size) : 0;
+    return end_ > 0;
+  }
+
+  int fd_;
+  size_t begin_;  // The next unread character of buffer_
+  size_t end_;    // The end of the data in buffer_
+  char buffer_[1 << 16];
+};
+
+class FastWriter {
+ public:
+  explicit FastWriter(int fd = 1) : fd_(fd) {}
+  ~FastWriter() { Flush(); }
+  FastWriter(const FastWriter &) = delete;
+  FastWriter &operator=(const FastWriter &) = delete;
+
+  // The pending output, to append to directly (e.g. MineSweeperGame::RenderMap()).
+  std::string &Buffer() { return buffer_; }
+
+  void Write(const char *text) { buffer_ += text; }
+
+  void WriteInt(int value) { buffer_ += std::to_string(value); }
+
+  void WriteBytes(const void *data, size_t size) { buffer_.append(static_cast<const char *>(data), size); }
+
+  // Write the pending output with as few write(2) calls as possible. Returns false on an error.
+  bool Flush() {
+    size_t written = 0;
+    while (written < buffer_.size()) {
+      ssize_t size = ::write(fd_, buffer_.data() + written, buffer_.size() - written);
+      if (size < 0 && errno == EINTR) {
+        continue;
+      }
+      if (size <= 0) {
+        buffer_.clear();
+        return false;
+      }
+      written += static_cast<size_t>(size);
+    }
+    buffer_.clear();
+    return true;
+  }
+
+ private:
+  int fd_;
+  std::string buffer_;  // Keeps its capacity, so the output of an operation does not allocate after the first
+};
+
+#endif
@@ -0,0 +1,333 @@
+/**
+ * This header file implements GaussianDeducer, the deduction tier of the client between the single-block rules of
+ * Client::DetectBlock() and the enumeration of FrontierSolver.
+ *
+ * Every visited block with unknown neighbours gives a linear equation over those neighbours (the variables, 1 for a
+ * mine): their sum is its mine count minus its marked neighbours. The equations are kept in reduced row echelon form
+ * by Gauss-Jordan elimination. A row stores its coefficients as two bitsets, the variables with coefficient +1 and the
+ * ones with -1, so that subtracting a row from another is a few word operations per 64 variables. An elimination that
+ * would give a coefficient of +2 or -2 (or clear the pivot of the row) is skipped, so a row may keep a few pivot
+ * columns of other rows; it is still a valid equation. A row sum(pos) - sum(neg) = rhs with rhs = |pos| forces every
+ * pos variable to be a mine and every neg variable to be safe (and the other way round if rhs = -|neg|). This finds
+ * patterns like 1-2-1 and 1-1 that span several visited blocks.
+ *
+ * The matrix is kept between moves: Update() substitutes the blocks that became known into the rows that use them and
+ * only adds the equations of newly visited blocks, then reduces the rows that changed.
+ */
+#ifndef GAUSS_H
+#define GAUSS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+
+namespace ClientNS {
+
+class GaussianDeducer {
+ public:
+  GaussianDeducer() { Reset(0, 0); }
+
+  void Reset(int rows, int columns) {
+    rows_ = rows;
+    columns_ = columns;
+    words_ = 0;
+    column_of_.Assign(rows, columns, -1);
+    block_of_.clear();
+    free_columns_.clear();
+    pivot_row_.clear();
+    reported_.clear();
+    matrix_.clear();
+    safe_.clear();
+    mines_.clear();
+  }
+
+  /**
+   * Apply the blocks of map whose content changed since the last Update() (row-major indices), reduce the matrix and
+   * collect the variables it proves safe or mines. Every block is reported at most once while it stays unknown.
+   */
+  void Update(const Grid<signed char> &map, const std::vector<int> &changed) {
+    safe_.clear();
+    mines_.clear();
+    // Substitute the variables that became known first, so that the new equations below use the final map.
+    for (int block : changed) {
+      int column = column_of_.At(block);
+      if (column >= 0 && map.At(block) != -1) {
+        Substitute(column, map.At(block) == -2 ? 1 : 0);
+      }
+    }
+    for (int block : changed) {
+      if (map.At(block) >= 0) {
+        AddEquation(map, block / columns_, block % columns_);
+      }
+    }
+    for (size_t r = 0; r < matrix_.size(); ++r) {
+      if (matrix_[r].touched && matrix_[r].pivot < 0) {
+        Reduce(static_cast<int>(r));
+      }
+    }
+    RemoveEmptyRows();
+    for (Row &row : matrix_) {
+      if (row.touched) {
+        Deduce(row);
+        row.touched = false;
+      }
+    }
+  }
+
+  // The blocks proved safe and mines by the last Update() (row-major indices).
+  const std::vector<int> &SafeBlocks() const { return safe_; }
+  const std::vector<int> &MineBlocks() const { return mines_; }
+
+  // The size of the matrix, for benchmarks.
+  int Equations() const { return static_cast<int>(matrix_.size()); }
+  int Variables() const { return static_cast<int>(block_of_.size() - free_columns_.size()); }
+
+ protected:
+  struct Row {
+    std::vector<uint64_t> pos;  // The variables with coefficient +1
+    std::vector<uint64_t> neg;  // The variables with coefficient -1
+    int rhs = 0;
+    int pivot = -1;        // The column eliminated from every other row, or -1
+    bool touched = false;  // Changed since the last Deduce()
+  };
+
+  static bool Test(const std::vector<uint64_t> &bits, int column) { return (bits[column >> 6] >> (column & 63)) & 1; }
+
+  static int Count(const std::vector<uint64_t> &bits) {
+    int count = 0;
+    for (uint64_t word : bits) {
+      count += __builtin_popcountll(word);
+    }
+    return count;
+  }
+
+  // The variable of the unknown block (r, c), allocating a column (and a word in every row) if it has none.
+  int ColumnOf(int r, int c) {
+    int block = r * columns_ + c;
+    if (column_of_.At(block) >= 0) {
+      return column_of_.At(block);
+    }
+    int column;
+    if (!free_columns_.empty()) {
+      column = free_columns_.back();
+      free_columns_.pop_back();
+    } else {
+      column = static_cast<int>(block_of_.size());
+      block_of_.push_back(-1);
+      pivot_row_.push_back(-1);
+      reported_.push_back(false);
+      if (column >= words_ * 64) {
+        ++words_;
+        for (Row &row : matrix_) {
+          row.pos.push_back(0);
+          row.neg.push_back(0);
+        }
+      }
+    }
+    block_of_[column] = block;
+    column_of_.At(block) = column;
+    pivot_row_[column] = -1;
+    reported_[column] = false;
+    return column;
+  }
+
+  // The variable of column became known: move it to the right-hand side of every row and free the column.
+  void Substitute(int column, int value) {
+    int word = column >> 6;
+    uint64_t bit = 1ULL << (column & 63);
+    for (Row &row : matrix_) {
+      if ((row.pos[word] | row.neg[word]) & bit) {
+        row.rhs -= (row.pos[word] & bit) ? value : -value;
+        row.pos[word] &= ~bit;
+        row.neg[word] &= ~bit;
+        row.touched = true;
+        if (row.pivot == column) {
+          row.pivot = -1;
+        }
+      }
+    }
+    column_of_.At(block_of_[column]) = -1;
+    block_of_[column] = -1;
+    pivot_row_[column] = -1;
+    free_columns_.push_back(column);
+  }
+
+  void AddEquation(const Grid<signed char> &map, int r, int c) {
+    int variables[8];
+    int count = 0;
+    Row row;
+    row.rhs = map[r][c];
+    row.touched = true;
+    for (int x = r - 1; x <= r + 1; ++x) {
+      for (int y = c - 1; y <= c + 1; ++y) {
+        if (x < 0 || x >= rows_ || y < 0 || y >= columns_ || (x == r && y == c)) {
+          continue;
+        }
+        if (map[x][y] == -2) {
+          --row.rhs;
+        } else if (map[x][y] == -1) {
+          variables[count++] = ColumnOf(x, y);
+        }
+      }
+    }
+    if (count == 0) {
+      return;
+    }
+    // The columns are allocated first, as a new column may add a word to every row.
+    row.pos.assign(words_, 0);
+    row.neg.assign(words_, 0);
+    for (int i = 0; i < count; ++i) {
+      row.pos[variables[i] >> 6] |= 1ULL << (variables[i] & 63);
+    }
+    matrix_.push_back(std::move(row));
+  }
+
+  /**
+   * Subtract coefficient * matrix_[from] from matrix_[to] to clear column, where coefficient is the coefficient of
+   * column in matrix_[to] and column has coefficient +1 in matrix_[from]. Returns false (and changes nothing) if a
+   * coefficient would leave {-1, 0, 1}, or if it would clear the pivot of matrix_[to] as well.
+   */
+  bool Eliminate(int to, int from, int column) {
+    Row &target = matrix_[to];
+    const Row &source = matrix_[from];
+    if (target.pivot >= 0 && (Test(source.pos, target.pivot) || Test(source.neg, target.pivot))) {
+      return false;
+    }
+    bool negate = Test(target.neg, column);
+    // The row to subtract, coefficient * source.
+    const std::vector<uint64_t> &sub_pos = negate ? source.neg : source.pos;
+    const std::vector<uint64_t> &sub_neg = negate ? source.pos : source.neg;
+    for (int w = 0; w < words_; ++w) {
+      if ((target.pos[w] & sub_neg[w]) || (target.neg[w] & sub_pos[w])) {
+        return false;
+      }
+    }
+    for (int w = 0; w < words_; ++w) {
+      uint64_t pos = (target.pos[w] & ~sub_pos[w]) | (sub_neg[w] & ~target.neg[w]);
+      uint64_t neg = (target.neg[w] & ~sub_neg[w]) | (sub_pos[w] & ~target.pos[w]);
+      target.pos[w] = pos;
+      target.neg[w] = neg;
+    }
+    target.rhs += negate ? source.rhs : -source.rhs;
+    target.touched = true;
+    return true;
+  }
+
+  /**
+   * Eliminate the pivot columns from row r, choose its own pivot among the columns left and eliminate it from every
+   * other row.
+   */
+  void Reduce(int r) {
+    for (int w = 0; w < words_; ++w) {
+      uint64_t bits = matrix_[r].pos[w] | matrix_[r].neg[w];
+      while (bits) {
+        int column = w * 64 + __builtin_ctzll(bits);
+        bits &= bits - 1;
+        int from = pivot_row_[column];
+        if (from >= 0 && from != r) {
+          Eliminate(r, from, column);
+          // Elimination only adds columns without a pivot (or skipped ones), so the rest of the word stays valid.
+          bits &= matrix_[r].pos[w] | matrix_[r].neg[w];
+        }
+      }
+    }
+    Row &row = matrix_[r];
+    int pivot = -1;
+    for (int w = 0; w < words_ && pivot < 0; ++w) {
+      uint64_t bits = row.pos[w] | row.neg[w];
+      while (bits) {
+        int column = w * 64 + __builtin_ctzll(bits);
+        bits &= bits - 1;
+        if (pivot_row_[column] < 0) {
+          pivot = column;
+          break;
+        }
+      }
+    }
+    if (pivot < 0) {
+      return;
+    }
+    if (Test(row.neg, pivot)) {
+      // Keep the pivot coefficient at +1.
+      row.pos.swap(row.neg);
+      row.rhs = -row.rhs;
+    }
+    row.pivot = pivot;
+    pivot_row_[pivot] = r;
+    int word = pivot >> 6;
+    uint64_t bit = 1ULL << (pivot & 63);
+    for (size_t other = 0; other < matrix_.size(); ++other) {
+      if (static_cast<int>(other) != r && ((matrix_[other].pos[word] | matrix_[other].neg[word]) & bit)) {
+        Eliminate(static_cast<int>(other), r, pivot);
+      }
+    }
+  }
+
+  // Drop the rows without variables left (0 = 0) and renumber the pivots.
+  void RemoveEmptyRows() {
+    size_t kept = 0;
+    for (size_t r = 0; r < matrix_.size(); ++r) {
+      bool empty = true;
+      for (int w = 0; w < words_ && empty; ++w) {
+        empty = (matrix_[r].pos[w] | matrix_[r].neg[w]) == 0;
+      }
+      if (empty) {
+        if (matrix_[r].pivot >= 0) {
+          pivot_row_[matrix_[r].pivot] = -1;
+        }
+        continue;
+      }
+      if (kept != r) {
+        matrix_[kept] = std::move(matrix_[r]);
+      }
+      if (matrix_[kept].pivot >= 0) {
+        pivot_row_[matrix_[kept].pivot] = static_cast<int>(kept);
+      }
+      ++kept;
+    }
+    matrix_.resize(kept);
+  }
+
+  void Deduce(const Row &row) {
+    int pos = Count(row.pos);
+    int neg = Count(row.neg);
+    if (row.rhs == pos) {
+      Report(row.pos, mines_);
+      Report(row.neg, safe_);
+    } else if (row.rhs == -neg) {
+      Report(row.pos, safe_);
+      Report(row.neg, mines_);
+    }
+  }
+
+  void Report(const std::vector<uint64_t> &bits, std::vector<int> &blocks) {
+    for (int w = 0; w < words_; ++w) {
+      uint64_t word = bits[w];
+      while (word) {
+        int column = w * 64 + __builtin_ctzll(word);
+        word &= word - 1;
+        if (!reported_[column]) {
+          reported_[column] = true;
+          blocks.push_back(block_of_[column]);
+        }
+      }
+    }
+  }
+
+  int rows_;
+  int columns_;
+  int words_;                      // The words of a row bitset
+  Grid<int> column_of_;            // The column of every unknown block on the frontier, or -1
+  std::vector<int> block_of_;      // The block of every column, or -1 if the column is free
+  std::vector<int> free_columns_;  // Columns to reuse for new variables
+  std::vector<int> pivot_row_;     // The row whose pivot is every column, or -1
+  std::vector<char> reported_;     // Whether every column has been proved safe or a mine already
+  std::vector<Row> matrix_;
+  std::vector<int> safe_;
+  std::vector<int> mines_;
+};
+
+}  // namespace ClientNS
+
+#endif
@@ -7,14 +7,22 @@
 #ifndef GENERATOR_H
 #define GENERATOR_H
 
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
 #include <random>
+#include <vector>
+
+#include "board.h"
+#include "philox.h"
 
 inline std::mt19937_64 gen;
 
 /**
  * Select a random number between [min, max]. All numbers have the same possibility to be selected.
  */
-inline int Random(int min, int max, std::mt19937_64 &gen) {
+template <class Rng>
+inline int Random(int min, int max, Rng &gen) {
   std::uniform_int_distribution<> dist(min, max);
   return dist(gen);
 }
@@ -35,16 +43,40 @@ inline void InitSeed(uint64_t random_seed) {
 }
 
 /**
- * Generate a map.
+ * The counter-based generator of board index of a run with the given seed. Unlike the stream of gen, it does not
+ * depend on the boards before, so boards can be generated in parallel, in any order, or one at a time.
  */
-inline void GenerateMap(int rows, int columns, int mine_count, int min_dist) {
+inline Philox4x32 BoardRandom(uint64_t seed, uint64_t index) {
+  return Philox4x32(seed, index);
+}
+
+/**
+ * The most blocks within min_dist (>= 0) of the first step of a rows * columns map (rows, columns >= 3), the blocks no
+ * mine may be placed in: the diamond around the first step clipped by the map is the largest for a first step in the
+ * middle. A map can hold at most rows * columns minus this many mines.
+ */
+inline int64_t MaxFirstStepArea(int rows, int columns, int min_dist) {
+  int row0 = (rows - 1) / 2;
+  int col0 = (columns - 1) / 2;
+  int64_t area = 0;
+  for (int i = std::max(0, row0 - min_dist); i <= std::min<int64_t>(rows - 1, int64_t{row0} + min_dist); ++i) {
+    int spread = min_dist - std::abs(i - row0);
+    area += std::min<int64_t>(columns - 1, int64_t{col0} + spread) - std::max(0, col0 - spread) + 1;
+  }
+  return area;
+}
+
+/**
+ * Generate a map with the given random generator and print it to out.
+ */
+template <class Rng>
+inline void GenerateMap(int rows, int columns, int mine_count, int min_dist, Rng &gen, std::ostream &out) {
   std::vector<std::pair<int, int>> available_block;
-  bool map[35][35];
+  Grid<bool> map(rows, columns, false);
   int row0 = Random(1, rows - 2, gen);
   int col0 = Random(1, columns - 2, gen);
   for (int i = 0; i < rows; ++i) {
     for (int j = 0; j < columns; ++j) {
-      map[i][j] = false;
       if (Dist(row0, col0, i, j) <= min_dist) {
         continue;
       }
@@ -58,14 +90,166 @@ inline void GenerateMap(int rows, int columns, int mine_count, int min_dist) {
     map[mine.first][mine.second] = true;
     available_block.erase(available_block.begin() + mine_pos);
   }
-  std::cout << rows << "  " << columns << std::endl;
+  out << rows << "  " << columns << std::endl;
   for (int i = 0; i < rows; ++i) {
     for (int j = 0; j < columns; ++j) {
-      std::cout << (map[i][j] ? 'X' : '.');
+      out << (map[i][j] ? 'X' : '.');
     }
-    std::cout << std::endl;
+    out << std::endl;
   }
-  std::cout << row0 << " " << col0 << std::endl;
+  out << row0 << " " << col0 << std::endl;
+}
+
+/**
+ * Generate a map.
+ */
+inline void GenerateMap(int rows, int columns, int mine_count, int min_dist) {
+  GenerateMap(rows, columns, mine_count, min_dist, gen, std::cout);
 }
 
-#endif
\ No newline at end of file
+/**
+ * The mines of many boards of the same size, packed one bit per block (bit r * columns + c of a board is set for a
+ * mine), with the first step of every board. The memory is kept by Clear(), so generating batch after batch into the
+ * same arena does not allocate.
+ */
+class BoardArena {
+ public:
+  BoardArena() { Assign(0, 0); }
+
+  // Set the size of the boards and remove all of them.
+  void Assign(int rows, int columns) {
+    rows_ = rows;
+    columns_ = columns;
+    words_ = (static_cast<size_t>(rows) * columns + 63) / 64;
+    Clear();
+  }
+
+  void Clear() {
+    mines_.clear();
+    first_steps_.clear();
+  }
+
+  // Add a board without mines and return its words.
+  uint64_t *Append() {
+    mines_.resize(mines_.size() + words_, 0);
+    first_steps_.resize(first_steps_.size() + 2, 0);
+    return mines_.data() + mines_.size() - words_;
+  }
+
+  void SetFirstStep(int index, int row, int column) {
+    first_steps_[2 * index] = row;
+    first_steps_[2 * index + 1] = column;
+  }
+
+  int Size() const { return static_cast<int>(first_steps_.size() / 2); }
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
+  size_t Words() const { return words_; }
+  const uint64_t *Mines(int index) const { return mines_.data() + index * words_; }
+  int FirstRow(int index) const { return first_steps_[2 * index]; }
+  int FirstColumn(int index) const { return first_steps_[2 * index + 1]; }
+
+ private:
+  int rows_;
+  int columns_;
+  size_t words_;  // The words of one board
+  std::vector<uint64_t> mines_;
+  std::vector<int> first_steps_;  // (row, column) of every board
+};
+
+/**
+ * Generate boards with the same rules as GenerateMap() (a random first step away from the border, no mine within
+ * min_dist of it), but without iostream: the mines are written into a byte buffer, a packed bitset or a BoardArena.
+ *
+ * Mines are placed by a partial Fisher-Yates shuffle of a permutation of all the blocks that is kept between boards:
+ * the blocks near the first step are swapped to the end, then the i-th mine is swapped with a random block after it.
+ * The swaps are undone afterwards, so every board only depends on the numbers drawn from gen (e.g. on its own
+ * BoardRandom() generator). A board costs O(mine_count + min_dist^2) instead of the O(rows * columns * mine_count) of
+ * erasing from a vector. The maps differ from the ones GenerateMap() makes with the same generator.
+ */
+class BoardGenerator {
+ public:
+  BoardGenerator(int rows, int columns, int mine_count, int min_dist)
+      : rows_(rows), columns_(columns), mine_count_(mine_count), min_dist_(min_dist) {}
+
+  /**
+   * Generate a board into mines, rows * columns bytes set to 1 for a mine and 0 otherwise.
+   */
+  template <class Rng>
+  void Generate(Rng &gen, unsigned char *mines, int &first_row, int &first_column) {
+    std::fill(mines, mines + static_cast<size_t>(rows_) * columns_, 0);
+    Place(gen, first_row, first_column, [mines](int block) { mines[block] = 1; });
+  }
+
+  /**
+   * Generate a board into mines, (rows * columns + 63) / 64 words with bit r * columns + c set for a mine.
+   */
+  template <class Rng>
+  void Generate(Rng &gen, uint64_t *mines, int &first_row, int &first_column) {
+    std::fill(mines, mines + (static_cast<size_t>(rows_) * columns_ + 63) / 64, 0);
+    Place(gen, first_row, first_column, [mines](int block) { mines[block >> 6] |= 1ULL << (block & 63); });
+  }
+
+  /**
+   * Append count boards to arena, which must have the size of the boards.
+   */
+  template <class Rng>
+  void Generate(Rng &gen, BoardArena &arena, int count) {
+    for (int i = 0; i < count; ++i) {
+      uint64_t *mines = arena.Append();
+      int first_row, first_column;
+      Place(gen, first_row, first_column, [mines](int block) { mines[block >> 6] |= 1ULL << (block & 63); });
+      arena.SetFirstStep(arena.Size() - 1, first_row, first_column);
+    }
+  }
+
+ private:
+  void Swap(int i, int j) {
+    std::swap(permutation_[i], permutation_[j]);
+    position_[permutation_[i]] = i;
+    position_[permutation_[j]] = j;
+    swaps_.emplace_back(i, j);
+  }
+
+  template <class Rng, class Mark>
+  void Place(Rng &gen, int &first_row, int &first_column, Mark mark) {
+    if (permutation_.empty()) {
+      permutation_.resize(static_cast<size_t>(rows_) * columns_);
+      position_.resize(permutation_.size());
+      for (size_t i = 0; i < permutation_.size(); ++i) {
+        permutation_[i] = static_cast<int>(i);
+        position_[i] = static_cast<int>(i);
+      }
+    }
+    first_row = Random(1, rows_ - 2, gen);
+    first_column = Random(1, columns_ - 2, gen);
+    int end = static_cast<int>(permutation_.size());
+    for (int i = std::max(0, first_row - min_dist_); i <= std::min(rows_ - 1, first_row + min_dist_); ++i) {
+      int spread = min_dist_ - std::abs(i - first_row);
+      for (int j = std::max(0, first_column - spread); j <= std::min(columns_ - 1, first_column + spread); ++j) {
+        Swap(position_[i * columns_ + j], --end);
+      }
+    }
+    for (int i = 0; i < mine_count_; ++i) {
+      Swap(i, Random(i, end - 1, gen));
+      mark(permutation_[i]);
+    }
+    // Back to the identity permutation.
+    for (auto swap = swaps_.rbegin(); swap != swaps_.rend(); ++swap) {
+      std::swap(permutation_[swap->first], permutation_[swap->second]);
+      position_[permutation_[swap->first]] = swap->first;
+      position_[permutation_[swap->second]] = swap->second;
+    }
+    swaps_.clear();
+  }
+
+  int rows_;
+  int columns_;
+  int mine_count_;
+  int min_dist_;
+  std::vector<int> permutation_;  // All the blocks, in order between boards (built by the first board)
+  std::vector<int> position_;     // The index of every block in permutation_
+  std::vector<std::pair<int, int>> swaps_;  // The swaps of the current board
+};
+
+#endif
@@ -0,0 +1,183 @@
+/**
+ * This header file implements KnowledgeState, what the client knows about the map: the content of every block and,
+ * for every block, the number of unknown and marked neighbours.
+ *
+ * The state can be changed hypothetically and rolled back in time proportional to the number of blocks changed:
+ * Snapshot() opens a checkpoint, every Set() after it appends the old content of the block to an undo log, and
+ * Restore() replays the log backwards to the checkpoint (Commit() keeps the changes instead). Checkpoints nest. The
+ * log and the work list of Propagate() keep their memory, so a lookahead that tries thousands of hypothetical reveals
+ * per decision does not allocate after the first few.
+ */
+#ifndef KNOWLEDGE_H
+#define KNOWLEDGE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "board.h"
+
+namespace ClientNS {
+
+class KnowledgeState {
+ public:
+  // The content of a block besides the mine counts 0-8 of visited blocks.
+  static const signed char kUnknown = -1;
+  static const signed char kMarked = -2;
+  static const signed char kSafe = -3;  // Known not to be a mine but not visited, only set by Propagate()
+
+  KnowledgeState() { Reset(0, 0); }
+
+  // Make every block of a rows * columns map unknown and drop the checkpoints.
+  void Reset(int rows, int columns) {
+    rows_ = rows;
+    columns_ = columns;
+    map_.Assign(rows, columns, kUnknown);
+    marked_count_.Assign(rows, columns, 0);
+    unknown_count_.Assign(rows, columns, 0);
+    for (int r = 0; r < rows; ++r) {
+      for (int c = 0; c < columns; ++c) {
+        unknown_count_[r][c] = static_cast<unsigned char>(Neighbours(r, c));
+      }
+    }
+    queued_.Assign(rows, columns, false);
+    log_.clear();
+    checkpoints_.clear();
+  }
+
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
+  const Grid<signed char> &Map() const { return map_; }
+  int MarkedCount(int r, int c) const { return marked_count_[r][c]; }
+  int UnknownCount(int r, int c) const { return unknown_count_[r][c]; }
+
+  // Set the content of block (r, c) and update the counters of its neighbours. Logged while a checkpoint is open.
+  void Set(int r, int c, int value) {
+    if (!checkpoints_.empty()) {
+      log_.push_back({r * columns_ + c, map_[r][c]});
+    }
+    Write(r, c, static_cast<signed char>(value));
+  }
+
+  void Snapshot() { checkpoints_.push_back(log_.size()); }
+
+  // Undo every Set() since the last Snapshot() and close that checkpoint.
+  void Restore() {
+    size_t checkpoint = checkpoints_.back();
+    checkpoints_.pop_back();
+    while (log_.size() > checkpoint) {
+      const Entry &entry = log_.back();
+      Write(entry.block / columns_, entry.block % columns_, entry.value);
+      log_.pop_back();
+    }
+  }
+
+  // Keep the changes since the last Snapshot() and close that checkpoint (they are undone by an outer Restore()).
+  void Commit() {
+    checkpoints_.pop_back();
+    if (checkpoints_.empty()) {
+      log_.clear();
+    }
+  }
+
+  // The number of open checkpoints.
+  int Depth() const { return static_cast<int>(checkpoints_.size()); }
+
+  // The number of blocks changed since the outermost open checkpoint.
+  size_t Changes() const { return log_.size(); }
+
+  /**
+   * Apply the single-block rules of Client::DetectBlock() to the visited blocks around (r, c) and, transitively,
+   * around every block they decide, until nothing changes: the unknown neighbours of a block are marked if they must
+   * all be mines, or set to kSafe if none can be. Returns false if some visited block can no longer be satisfied, i.e.
+   * the current state is impossible.
+   */
+  bool Propagate(int r, int c) {
+    work_.clear();
+    Enqueue(r, c);
+    bool consistent = true;
+    for (size_t next = 0; next < work_.size() && consistent; ++next) {
+      int i = work_[next] / columns_;
+      int j = work_[next] % columns_;
+      int value = map_[i][j];
+      if (value < 0) {
+        continue;
+      }
+      int marked = marked_count_[i][j];
+      int unknown = unknown_count_[i][j];
+      if (marked > value || marked + unknown < value) {
+        consistent = false;
+      } else if (unknown > 0 && (marked == value || marked + unknown == value)) {
+        signed char decided = marked == value ? kSafe : kMarked;
+        for (int x = i - 1; x <= i + 1; ++x) {
+          for (int y = j - 1; y <= j + 1; ++y) {
+            if (x >= 0 && x < rows_ && y >= 0 && y < columns_ && map_[x][y] == kUnknown) {
+              Set(x, y, decided);
+              Enqueue(x, y);
+            }
+          }
+        }
+      }
+    }
+    for (int block : work_) {
+      queued_.At(block) = false;
+    }
+    return consistent;
+  }
+
+ private:
+  struct Entry {
+    int block;
+    signed char value;
+  };
+
+  int Neighbours(int r, int c) const {
+    int rows = (r > 0) + 1 + (r + 1 < rows_);
+    int columns = (c > 0) + 1 + (c + 1 < columns_);
+    return rows * columns - 1;
+  }
+
+  void Write(int r, int c, signed char value) {
+    Count(r, c, map_[r][c], -1);
+    map_[r][c] = value;
+    Count(r, c, value, 1);
+  }
+
+  // Add delta to the counter of the neighbours of (r, c) that a block with content value contributes to.
+  void Count(int r, int c, signed char value, int delta) {
+    if (value != kUnknown && value != kMarked) {
+      return;
+    }
+    // The counters are padded: the counts of the border are never read, so the loop needs no bounds check.
+    PaddedGrid<unsigned char> &count = value == kUnknown ? unknown_count_ : marked_count_;
+    int index = count.Index(r, c);
+    for (int offset : count.Offsets()) {
+      count.At(index + offset) += delta;
+    }
+  }
+
+  // Queue the visited blocks in the 3 * 3 area of (r, c) for Propagate().
+  void Enqueue(int r, int c) {
+    for (int x = r - 1; x <= r + 1; ++x) {
+      for (int y = c - 1; y <= c + 1; ++y) {
+        if (x >= 0 && x < rows_ && y >= 0 && y < columns_ && map_[x][y] >= 0 && !queued_[x][y]) {
+          queued_[x][y] = true;
+          work_.push_back(x * columns_ + y);
+        }
+      }
+    }
+  }
+
+  int rows_;
+  int columns_;
+  Grid<signed char> map_;  // kUnknown, kMarked, kSafe or the mine count of a visited block
+  PaddedGrid<unsigned char> marked_count_;
+  PaddedGrid<unsigned char> unknown_count_;
+  std::vector<Entry> log_;           // The old content of every block set since the outermost checkpoint
+  std::vector<size_t> checkpoints_;  // The size of log_ at every open Snapshot()
+  std::vector<int> work_;            // The blocks Propagate() checks, in order
+  Grid<bool> queued_;                // Whether every block is in work_
+};
+
+}  // namespace ClientNS
+
+#endif
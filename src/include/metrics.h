@@ -0,0 +1,262 @@
+/**
+ * This header file implements the optional instrumentation of the hot paths: per-phase timers and per-decision
+ * counters, collected for every game of a batch and exported by `client --batch --metrics-csv/--metrics-json`.
+ *
+ * The instrumentation is only compiled with MINESWEEPER_METRICS defined (cmake -DMINESWEEPER_METRICS=ON). Otherwise
+ * every METRICS_* macro expands to nothing and its arguments are not even evaluated, so the default build is exactly
+ * the uninstrumented code.
+ *
+ * Metrics go to the GameMetrics of the current thread, set by a Recorder for the duration of a game (see RecordGame()
+ * in batch.h). Code running without a recorder, like a single game of TestSingle(), records nothing.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace Metrics {
+
+enum Phase {
+  kGenerate,   // Generating the map
+  kLoad,       // Loading the map into the server
+  kExecute,    // MineSweeperGame/BitboardGame::Execute(), including cascades
+  kTransport,  // Passing the result to the client: PrintMap() and ReadMap(), or Observe()
+  kDetect,     // The single-block rules of the client
+  kGaussian,   // GaussianDeducer
+  kSolver,     // FrontierSolver
+  kPhaseCount
+};
+
+enum Counter {
+  kDecisions,         // Calls of Client::NextOperation()
+  kRuleDeductions,    // Operations queued by the single-block rules
+  kGaussDeductions,   // Operations queued by GaussianDeducer
+  kSolverDeductions,  // Operations queued by FrontierSolver
+  kSolverGuesses,     // Decisions that visit the least risky block of the solver
+  kRandomGuesses,     // Decisions that visit a random unknown block
+  kQueueDepth,        // The sum over the decisions of the size of op_queue, counting the operation returned
+  kCascades,          // Visits that opened more than the visited block
+  kCascadeBlocks,     // The blocks opened by those visits besides the visited one
+  kGuessAtLoss,       // 1 if the game was lost on a guess
+  kCounterCount
+};
+
+enum Maximum {
+  kMaxQueueDepth,
+  kMaxCascadeBlocks,
+  kMaximumCount
+};
+
+const char *const kPhaseNames[kPhaseCount] = {"generate", "load", "execute", "transport", "detect", "gaussian",
+                                              "solver"};
+const char *const kCounterNames[kCounterCount] = {
+    "decisions",      "rule_deductions", "gauss_deductions", "solver_deductions", "solver_guesses",
+    "random_guesses", "queue_depth",     "cascades",         "cascade_blocks",    "guess_at_loss"};
+const char *const kMaximumNames[kMaximumCount] = {"max_queue_depth", "max_cascade_blocks"};
+
+struct GameMetrics {
+  uint64_t phase_ns[kPhaseCount] = {};
+  uint64_t phase_calls[kPhaseCount] = {};
+  uint64_t counters[kCounterCount] = {};
+  uint64_t maxima[kMaximumCount] = {};
+  bool last_guess = false;  // Whether the last decision was a guess
+
+  // Accumulate other: sums for the timers and counters, maximum for the maxima.
+  void Add(const GameMetrics &other) {
+    for (int i = 0; i < kPhaseCount; ++i) {
+      phase_ns[i] += other.phase_ns[i];
+      phase_calls[i] += other.phase_calls[i];
+    }
+    for (int i = 0; i < kCounterCount; ++i) {
+      counters[i] += other.counters[i];
+    }
+    for (int i = 0; i < kMaximumCount; ++i) {
+      maxima[i] = std::max(maxima[i], other.maxima[i]);
+    }
+  }
+};
+
+// The metrics of the game played by this thread, or nullptr.
+inline thread_local GameMetrics *current = nullptr;
+
+/**
+ * Record the metrics of this thread into metrics while alive. Recorders nest: the previous target is restored.
+ */
+class Recorder {
+ public:
+  explicit Recorder(GameMetrics *metrics) : previous_(current) { current = metrics; }
+  ~Recorder() { current = previous_; }
+  Recorder(const Recorder &) = delete;
+  Recorder &operator=(const Recorder &) = delete;
+
+ private:
+  GameMetrics *previous_;
+};
+
+// The metrics recorded outside of any game: the maps a sequential batch generates on its own thread.
+inline GameMetrics &BatchMetrics() {
+  static GameMetrics metrics;
+  return metrics;
+}
+
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(Phase phase) : metrics_(current), phase_(phase) {
+    if (metrics_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~PhaseTimer() {
+    if (metrics_ != nullptr) {
+      auto elapsed = std::chrono::steady_clock::now() - start_;
+      metrics_->phase_ns[phase_] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      ++metrics_->phase_calls[phase_];
+    }
+  }
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+ private:
+  GameMetrics *metrics_;
+  Phase phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Count the blocks a visit opens besides the visited one, from the visit count of the server before the visited block
+ * is counted and after the cascade.
+ */
+class CascadeCounter {
+ public:
+  explicit CascadeCounter(const int &visit_count) : visit_count_(visit_count), start_(visit_count) {}
+  ~CascadeCounter() {
+    int opened = visit_count_ - start_ - 1;
+    if (current != nullptr && opened > 0) {
+      ++current->counters[kCascades];
+      current->counters[kCascadeBlocks] += opened;
+      current->maxima[kMaxCascadeBlocks] = std::max<uint64_t>(current->maxima[kMaxCascadeBlocks], opened);
+    }
+  }
+  CascadeCounter(const CascadeCounter &) = delete;
+  CascadeCounter &operator=(const CascadeCounter &) = delete;
+
+ private:
+  const int &visit_count_;
+  int start_;
+};
+
+inline void Add(Counter counter, uint64_t value) {
+  if (current != nullptr) {
+    current->counters[counter] += value;
+  }
+}
+
+inline void Max(Maximum maximum, uint64_t value) {
+  if (current != nullptr) {
+    current->maxima[maximum] = std::max(current->maxima[maximum], value);
+  }
+}
+
+inline void Guess(bool guess) {
+  if (current != nullptr) {
+    current->last_guess = guess;
+  }
+}
+
+inline void GameOver(bool lost) {
+  if (current != nullptr && lost && current->last_guess) {
+    ++current->counters[kGuessAtLoss];
+  }
+}
+
+// The column names of WriteCsvRow().
+inline void WriteCsvHeader(std::ostream &out) {
+  for (const char *name : kCounterNames) {
+    out << "," << name;
+  }
+  for (const char *name : kMaximumNames) {
+    out << "," << name;
+  }
+  for (const char *name : kPhaseNames) {
+    out << "," << name << "_ns," << name << "_calls";
+  }
+}
+
+// The metrics as CSV fields, each preceded by a comma.
+inline void WriteCsvRow(std::ostream &out, const GameMetrics &metrics) {
+  for (uint64_t value : metrics.counters) {
+    out << "," << value;
+  }
+  for (uint64_t value : metrics.maxima) {
+    out << "," << value;
+  }
+  for (int i = 0; i < kPhaseCount; ++i) {
+    out << "," << metrics.phase_ns[i] << "," << metrics.phase_calls[i];
+  }
+}
+
+/**
+ * The totals of a batch of games as JSON members (without the braces), with the usual ratios derived from them.
+ */
+inline void WriteJsonMembers(std::ostream &out, const GameMetrics &total, uint64_t games, uint64_t losses) {
+  auto ratio = [](uint64_t a, uint64_t b) { return b > 0 ? static_cast<double>(a) / b : 0.0; };
+  const uint64_t *counters = total.counters;
+  uint64_t deductions = counters[kRuleDeductions] + counters[kGaussDeductions] + counters[kSolverDeductions];
+  uint64_t guesses = counters[kSolverGuesses] + counters[kRandomGuesses];
+  out << "  \"counters\": {";
+  for (int i = 0; i < kCounterCount; ++i) {
+    out << (i ? ", " : "") << "\"" << kCounterNames[i] << "\": " << counters[i];
+  }
+  out << "},\n  \"maxima\": {";
+  for (int i = 0; i < kMaximumCount; ++i) {
+    out << (i ? ", " : "") << "\"" << kMaximumNames[i] << "\": " << total.maxima[i];
+  }
+  out << "},\n  \"phases\": {";
+  for (int i = 0; i < kPhaseCount; ++i) {
+    out << (i ? ",\n" : "\n") << "    \"" << kPhaseNames[i] << "\": {\"total_ns\": " << total.phase_ns[i]
+        << ", \"calls\": " << total.phase_calls[i]
+        << ", \"mean_ns\": " << ratio(total.phase_ns[i], total.phase_calls[i])
+        << ", \"per_game_ns\": " << ratio(total.phase_ns[i], games) << "}";
+  }
+  out << "\n  },\n  \"derived\": {";
+  out << "\"deductions_per_game\": " << ratio(deductions, games);
+  out << ", \"guesses_per_game\": " << ratio(guesses, games);
+  out << ", \"guess_fraction\": " << ratio(guesses, deductions + guesses);
+  out << ", \"mean_queue_depth\": " << ratio(counters[kQueueDepth], counters[kDecisions]);
+  out << ", \"blocks_per_cascade\": " << ratio(counters[kCascadeBlocks], counters[kCascades]);
+  out << ", \"losses_on_guess\": " << ratio(counters[kGuessAtLoss], losses) << "}";
+}
+
+}  // namespace Metrics
+
+#define METRICS_CONCAT_INNER(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_INNER(a, b)
+
+#ifdef MINESWEEPER_METRICS
+// Time the rest of the enclosing scope as phase.
+#define METRICS_PHASE(phase) Metrics::PhaseTimer METRICS_CONCAT(metrics_timer_, __LINE__)(Metrics::phase)
+// Count the blocks opened in the rest of the enclosing scope besides the visited one, from the server's visit count.
+#define METRICS_CASCADE(visit_count) Metrics::CascadeCounter METRICS_CONCAT(metrics_cascade_, __LINE__)(visit_count)
+#define METRICS_ADD(counter, value) Metrics::Add(Metrics::counter, value)
+#define METRICS_MAX(maximum, value) Metrics::Max(Metrics::maximum, value)
+// Whether the decision just made is a guess, for kGuessAtLoss.
+#define METRICS_GUESS(guess) Metrics::Guess(guess)
+#define METRICS_GAME_OVER(lost) Metrics::GameOver(lost)
+// Record into BatchMetrics() (cleared first) for the rest of the enclosing scope.
+#define METRICS_BATCH()                           \
+  Metrics::BatchMetrics() = Metrics::GameMetrics(); \
+  Metrics::Recorder metrics_batch_recorder(&Metrics::BatchMetrics())
+#else
+#define METRICS_PHASE(phase) ((void)0)
+#define METRICS_CASCADE(visit_count) ((void)0)
+#define METRICS_ADD(counter, value) ((void)0)
+#define METRICS_MAX(maximum, value) ((void)0)
+#define METRICS_GUESS(guess) ((void)0)
+#define METRICS_GAME_OVER(lost) ((void)0)
+#define METRICS_BATCH() ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * This header file implements CountNeighbours(), which computes for every block of a map how many of its 8 neighbours
+ * are set in a plane of 0/1 bytes (e.g. the mine count of every block from the mines, for InitMap()).
+ *
+ * Instead of adding 1 to the 8 neighbours of every set block with bounds checks, the plane is copied into a buffer
+ * with a zero border, and every count is the sum of the 3 * 3 area around the block minus the block itself: sums of
+ * shifted rows, without any branch per block. The sums are computed 32 blocks at a time with AVX2 or 16 with SSE2,
+ * whichever the CPU supports (checked once at run time), or one at a time by the portable kernel. All the kernels give
+ * exactly the same counts.
+ */
+#ifndef NEIGHBOURS_H
+#define NEIGHBOURS_H
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NEIGHBOURS_X86 1
+#endif
+
+enum class NeighbourKernel { kScalar, kSse2, kAvx2 };
+
+/**
+ * The zero-bordered copy of a plane the kernels read: row r, column c of the plane is at (r + 1) * stride + c + 1.
+ * The stride leaves room after the last column for a whole vector, so that the kernels never need a scalar tail.
+ */
+class PaddedPlane {
+ public:
+  static const int kVector = 32;  // The widest vector of the kernels, in bytes
+
+  /**
+   * Copy plane in, row r starting at plane + r * plane_stride. The border and the room after every row stay zero, so
+   * they are only cleared when the size changes.
+   */
+  void Load(const unsigned char *plane, size_t plane_stride, int rows, int columns) {
+    if (rows != rows_ || columns != columns_) {
+      rows_ = rows;
+      columns_ = columns;
+      stride_ = (static_cast<size_t>(columns) + kVector - 1) / kVector * kVector + kVector;
+      data_.assign(stride_ * (rows + 2), 0);
+    }
+    for (int r = 0; r < rows; ++r) {
+      std::memcpy(&data_[(r + 1) * stride_ + 1], plane + r * plane_stride, columns);
+    }
+  }
+
+  int Rows() const { return rows_; }
+  int Columns() const { return columns_; }
+  size_t Stride() const { return stride_; }
+  // The first byte of padded row r (row r - 1 of the plane, row 0 is the top border).
+  const unsigned char *Row(int r) const { return data_.data() + r * stride_; }
+
+ private:
+  int rows_ = 0;
+  int columns_ = 0;
+  size_t stride_ = 0;
+  std::vector<unsigned char> data_;
+};
+
+// The counts of row r, one block at a time.
+inline void CountNeighboursRowScalar(const PaddedPlane &padded, int r, unsigned char *counts) {
+  const unsigned char *above = padded.Row(r);
+  const unsigned char *row = padded.Row(r + 1);
+  const unsigned char *below = padded.Row(r + 2);
+  for (int c = 0; c < padded.Columns(); ++c) {
+    counts[c] = static_cast<unsigned char>(above[c] + above[c + 1] + above[c + 2] + row[c] + row[c + 2] + below[c] +
+                                           below[c + 1] + below[c + 2]);
+  }
+}
+
+#ifdef NEIGHBOURS_X86
+// The counts of row r, 16 blocks at a time, into row_buffer (at least the columns rounded up to kVector bytes).
+inline void CountNeighboursRowSse2(const PaddedPlane &padded, int r, unsigned char *row_buffer) {
+  const char *above = reinterpret_cast<const char *>(padded.Row(r));
+  const char *row = reinterpret_cast<const char *>(padded.Row(r + 1));
+  const char *below = reinterpret_cast<const char *>(padded.Row(r + 2));
+  for (int c = 0; c < padded.Columns(); c += 16) {
+    const char *a = above + c;
+    const char *m = row + c;
+    const char *b = below + c;
+    __m128i sum = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + 1)));
+    sum = _mm_add_epi8(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + 2)));
+    sum = _mm_add_epi8(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(m)));
+    sum = _mm_add_epi8(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(m + 2)));
+    sum = _mm_add_epi8(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b)));
+    sum = _mm_add_epi8(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + 1)));
+    sum = _mm_add_epi8(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + 2)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(row_buffer + c), sum);
+  }
+}
+
+// The same as CountNeighboursRowSse2(), 32 blocks at a time.
+__attribute__((target("avx2"))) inline void CountNeighboursRowAvx2(const PaddedPlane &padded, int r,
+                                                                    unsigned char *row_buffer) {
+  const char *above = reinterpret_cast<const char *>(padded.Row(r));
+  const char *row = reinterpret_cast<const char *>(padded.Row(r + 1));
+  const char *below = reinterpret_cast<const char *>(padded.Row(r + 2));
+  for (int c = 0; c < padded.Columns(); c += 32) {
+    const char *a = above + c;
+    const char *m = row + c;
+    const char *b = below + c;
+    __m256i sum = _mm256_add_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a)),
+                                  _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + 1)));
+    sum = _mm256_add_epi8(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + 2)));
+    sum = _mm256_add_epi8(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(m)));
+    sum = _mm256_add_epi8(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(m + 2)));
+    sum = _mm256_add_epi8(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b)));
+    sum = _mm256_add_epi8(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + 1)));
+    sum = _mm256_add_epi8(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + 2)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(row_buffer + c), sum);
+  }
+}
+#endif
+
+// Whether the CPU can run kernel.
+inline bool NeighbourKernelSupported(NeighbourKernel kernel) {
+#ifdef NEIGHBOURS_X86
+  if (kernel == NeighbourKernel::kAvx2) {
+    return __builtin_cpu_supports("avx2");
+  }
+  if (kernel == NeighbourKernel::kSse2) {
+    return __builtin_cpu_supports("sse2");
+  }
+#endif
+  return kernel == NeighbourKernel::kScalar;
+}
+
+/**
+ * The kernel CountNeighbours() uses: the widest one the CPU supports, unless changed (e.g. by the benchmarks to compare
+ * them). Change it before any thread counts.
+ */
+inline NeighbourKernel &ActiveNeighbourKernel() {
+  static NeighbourKernel kernel = NeighbourKernelSupported(NeighbourKernel::kAvx2)   ? NeighbourKernel::kAvx2
+                                  : NeighbourKernelSupported(NeighbourKernel::kSse2) ? NeighbourKernel::kSse2
+                                                                                     : NeighbourKernel::kScalar;
+  return kernel;
+}
+
+/**
+ * Set counts[r * counts_stride + c] to the number of the 8 neighbours of block (r, c) whose byte
+ * plane[r * plane_stride + c] is 1 (the bytes of a rows * columns map are 0 or 1), with kernel. The strides let both be
+ * the rows of a PaddedGrid.
+ */
+inline void CountNeighbours(const unsigned char *plane, size_t plane_stride, int rows, int columns,
+                            unsigned char *counts, size_t counts_stride, NeighbourKernel kernel) {
+  thread_local PaddedPlane padded;
+  thread_local std::vector<unsigned char> row_buffer;
+  padded.Load(plane, plane_stride, rows, columns);
+#ifdef NEIGHBOURS_X86
+  if (kernel != NeighbourKernel::kScalar) {
+    row_buffer.resize(padded.Stride());
+    for (int r = 0; r < rows; ++r) {
+      if (kernel == NeighbourKernel::kAvx2) {
+        CountNeighboursRowAvx2(padded, r, row_buffer.data());
+      } else {
+        CountNeighboursRowSse2(padded, r, row_buffer.data());
+      }
+      std::memcpy(counts + r * counts_stride, row_buffer.data(), columns);
+    }
+    return;
+  }
+#endif
+  for (int r = 0; r < rows; ++r) {
+    CountNeighboursRowScalar(padded, r, counts + r * counts_stride);
+  }
+}
+
+// CountNeighbours() of a rows * columns row-major plane into rows * columns row-major counts.
+inline void CountNeighbours(const unsigned char *plane, int rows, int columns, unsigned char *counts,
+                            NeighbourKernel kernel) {
+  CountNeighbours(plane, columns, rows, columns, counts, columns, kernel);
+}
+
+inline void CountNeighbours(const unsigned char *plane, int rows, int columns, unsigned char *counts) {
+  CountNeighbours(plane, rows, columns, counts, ActiveNeighbourKernel());
+}
+
+#endif
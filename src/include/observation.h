@@ -0,0 +1,104 @@
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include <istream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A block whose visible content changed during the last operation.
+ *
+ * @details value uses the same encoding as the client's map: -1 for an unknown block, -2 for a marked block and 0-8 for
+ * the mine count of a visited block. This is exactly what ReadMap() would parse from the corresponding character of
+ * PrintMap(), so applying the changes and re-reading the whole map lead to the same client state.
+ */
+struct CellChange {
+    int row;
+    int column;
+    int value;
+};
+
+typedef std::vector<CellChange> CellChanges;
+
+/**
+ * @brief An operation decided by the client: type 0 for VisitBlock, 1 for MarkMine and 2 for AutoExplore.
+ */
+struct Operation {
+    int row;
+    int column;
+    int type;
+};
+
+/**
+ * @brief How the server passes the result of an operation to the client.
+ *
+ * @details kObserve hands over the CellChanges directly, kText prints the whole map with PrintMap() and parses it with
+ * ReadMap() like the judger on OJ, and kDelta prints only the changed blocks with PrintChanges() and parses them with
+ * ReadChanges() (see FormatChanges()). All three lead to the same game.
+ */
+enum class Protocol { kObserve, kText, kDelta };
+
+/**
+ * @brief Append the delta output of an operation to out.
+ *
+ * @details The delta output is a line "count game_state" followed by count lines "row column value", one per changed
+ * block in the order they changed, with value encoded as in CellChange. For example, VisitBlock(2, 0) on the 3 * 3 map
+ * of server.h gives
+ *     4 0
+ *     2 0 0
+ *     2 1 1
+ *     1 0 1
+ *     1 1 2
+ * The count comes first so that the reader knows how many lines to parse without a terminator.
+ */
+inline void FormatChanges(std::string &out, const CellChanges &changes, int game_state) {
+    // Append a small integer (a coordinate, a count or a value) without going through a stream.
+    auto append = [&out](int value, char separator) {
+        char digits[12];
+        int length = 0;
+        unsigned magnitude = value < 0 ? 0u - static_cast<unsigned>(value) : static_cast<unsigned>(value);
+        do {
+            digits[length++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0) {
+            out += '-';
+        }
+        while (length > 0) {
+            out += digits[--length];
+        }
+        out += separator;
+    };
+    append(static_cast<int>(changes.size()), ' ');
+    append(game_state, '\n');
+    for (const CellChange &change : changes) {
+        append(change.row, ' ');
+        append(change.column, ' ');
+        append(change.value, '\n');
+    }
+}
+
+/**
+ * @brief Parse one delta output of FormatChanges() for a rows * columns map from in into changes and game_state.
+ *
+ * @details Every block changes at most once per game, so a count above rows * columns, like a block outside the map
+ * or a value outside -2..8, can only come from a malformed input and is rejected before anything is allocated.
+ *
+ * @return false if the input ends or is malformed before the whole delta output is read.
+ */
+inline bool ParseChanges(std::istream &in, CellChanges &changes, int &game_state, int rows, int columns) {
+    long long count;
+    if (!(in >> count >> game_state) || count < 0 || count > static_cast<long long>(rows) * columns) {
+        return false;
+    }
+    changes.resize(count);
+    for (CellChange &change : changes) {
+        if (!(in >> change.row >> change.column >> change.value) || change.row < 0 || change.row >= rows ||
+            change.column < 0 || change.column >= columns || change.value < -2 || change.value > 8) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // OBSERVATION_H
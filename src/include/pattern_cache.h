@@ -0,0 +1,170 @@
+/**
+ * This header file implements PatternCache, a cache of the enumeration results of small frontier components shared by
+ * all the clients of a process (e.g. the games of a batch on every worker thread).
+ *
+ * The same small components (a 1-2-1 along a wall, a lone number next to a corner) come up again and again across
+ * moves and boards. FrontierSolver keys a component by its shape: the relative positions of its unknown blocks and of
+ * the visited blocks constraining them with their remaining mine counts, reduced over the 8 rotations and reflections
+ * of the board (see FrontierSolver::PatternOf()). The shape determines the constraints completely, so two components
+ * with the same key have the same counts once their blocks are numbered in the canonical order of the key.
+ *
+ * The cache is a set-associative table of fixed-size slots with CLOCK replacement inside every set. Readers never
+ * lock: every slot is a seqlock, and a read that overlaps a write is simply a miss. Writers (one per miss) take a
+ * mutex. A key is a 128-bit hash of the shape; a false hit needs a collision of both halves.
+ */
+#ifndef PATTERN_CACHE_H
+#define PATTERN_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ClientNS {
+
+struct PatternKey {
+  uint64_t hash[2] = {0, 0};
+  int variables = 0;
+};
+
+class PatternCache {
+ public:
+  static const int kMinVariables = 4;   // Smaller components are enumerated faster than looked up
+  static const int kMaxVariables = 16;  // Larger components are not cached
+  static const int kWays = 4;           // Slots per set
+
+  // A cache of at least slots slots (rounded up to a power of two, at least one set).
+  explicit PatternCache(size_t slots) {
+    size_t sets = 1;
+    while (sets * kWays < slots) {
+      sets *= 2;
+    }
+    set_mask_ = sets - 1;
+    slots_.reset(new Slot[sets * kWays]);
+  }
+
+  PatternCache(const PatternCache &) = delete;
+  PatternCache &operator=(const PatternCache &) = delete;
+
+  size_t Slots() const { return (set_mask_ + 1) * kWays; }
+
+  /**
+   * Look key up. On a hit, count[k] and mine_count[k][q] (q in the canonical order of the key) are filled like
+   * ComponentCounts and true is returned.
+   */
+  bool Find(const PatternKey &key, std::vector<uint64_t> &count, std::vector<std::vector<uint64_t>> &mine_count) {
+    int n = key.variables;
+    Slot *set = &slots_[(key.hash[0] & set_mask_) * kWays];
+    for (int way = 0; way < kWays; ++way) {
+      Slot &slot = set[way];
+      uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+      if ((sequence & 1) != 0 || slot.key[0].load(std::memory_order_relaxed) != key.hash[0] ||
+          slot.key[1].load(std::memory_order_relaxed) != key.hash[1] ||
+          slot.variables.load(std::memory_order_relaxed) != n) {
+        continue;
+      }
+      count.assign(n + 1, 0);
+      mine_count.assign(n + 1, std::vector<uint64_t>(n, 0));
+      const std::atomic<uint32_t> *data = slot.data;
+      for (int k = 0; k <= n; ++k) {
+        count[k] = (data++)->load(std::memory_order_relaxed);
+        for (int q = 0; q < n; ++q) {
+          mine_count[k][q] = (data++)->load(std::memory_order_relaxed);
+        }
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+        break;  // Overwritten while reading
+      }
+      slot.referenced.store(1, std::memory_order_relaxed);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  /**
+   * Store the counts of key (in the canonical order of the key, see Find()). Counts must fit in 32 bits, which they do
+   * for kMaxVariables variables.
+   */
+  void Insert(const PatternKey &key, const std::vector<uint64_t> &count,
+              const std::vector<std::vector<uint64_t>> &mine_count) {
+    int n = key.variables;
+    if (n > kMaxVariables) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    size_t set_index = key.hash[0] & set_mask_;
+    Slot *set = &slots_[set_index * kWays];
+    // An empty slot or the next one without the referenced bit, clearing the bits on the way (CLOCK).
+    Slot *victim = nullptr;
+    for (int way = 0; way < kWays && victim == nullptr; ++way) {
+      if (set[way].variables.load(std::memory_order_relaxed) < 0) {
+        victim = &set[way];
+      }
+    }
+    if (victim == nullptr) {
+      uint8_t &hand = hands_[set_index % kHands];
+      while (set[hand % kWays].referenced.exchange(0, std::memory_order_relaxed) != 0) {
+        hand = static_cast<uint8_t>((hand + 1) % kWays);
+      }
+      victim = &set[hand % kWays];
+      hand = static_cast<uint8_t>((hand + 1) % kWays);
+      evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint32_t sequence = victim->sequence.load(std::memory_order_relaxed);
+    victim->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    victim->key[0].store(key.hash[0], std::memory_order_relaxed);
+    victim->key[1].store(key.hash[1], std::memory_order_relaxed);
+    victim->variables.store(n, std::memory_order_relaxed);
+    std::atomic<uint32_t> *data = victim->data;
+    for (int k = 0; k <= n; ++k) {
+      (data++)->store(static_cast<uint32_t>(count[k]), std::memory_order_relaxed);
+      for (int q = 0; q < n; ++q) {
+        (data++)->store(static_cast<uint32_t>(mine_count[k][q]), std::memory_order_relaxed);
+      }
+    }
+    victim->referenced.store(0, std::memory_order_relaxed);
+    victim->sequence.store(sequence + 2, std::memory_order_release);
+    inserts_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t Hits() const { return hits_.load(std::memory_order_relaxed); }
+  uint64_t Misses() const { return misses_.load(std::memory_order_relaxed); }
+  uint64_t Inserts() const { return inserts_.load(std::memory_order_relaxed); }
+  uint64_t Evictions() const { return evictions_.load(std::memory_order_relaxed); }
+
+  double HitRate() const {
+    uint64_t lookups = Hits() + Misses();
+    return lookups > 0 ? static_cast<double>(Hits()) / lookups : 0;
+  }
+
+ private:
+  static const int kHands = 1 << 12;  // CLOCK hands, shared by the sets with the same low bits
+
+  struct Slot {
+    std::atomic<uint32_t> sequence{0};  // Odd while the slot is being written
+    std::atomic<uint64_t> key[2] = {};
+    std::atomic<int> variables{-1};  // -1 for an empty slot
+    std::atomic<uint8_t> referenced{0};
+    // count[k] followed by mine_count[k][0..n), for k = 0..n
+    std::atomic<uint32_t> data[(kMaxVariables + 1) * (kMaxVariables + 1)] = {};
+  };
+
+  size_t set_mask_;
+  std::unique_ptr<Slot[]> slots_;
+  std::mutex write_mutex_;
+  uint8_t hands_[kHands] = {};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> inserts_{0};
+  std::atomic<uint64_t> evictions_{0};
+};
+
+}  // namespace ClientNS
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * This header file implements Philox4x32, the counter-based random generator Philox4x32-10 of Salmon et al., "Parallel
+ * random numbers: as easy as 1, 2, 3" (SC 2011).
+ *
+ * Output block n of a generator is a keyed bijection of the 128-bit counter (n, stream), so a generator for (seed,
+ * stream) can be created anywhere in O(1) and gives the same numbers in every thread. Batches use one stream per board
+ * (see BoardRandom() in generator.h), so any board of a run can be generated alone and in any order.
+ */
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+
+class Philox4x32 {
+ public:
+  typedef uint64_t result_type;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~0ULL; }
+
+  explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0) { Seed(seed, stream); }
+
+  void Seed(uint64_t seed, uint64_t stream = 0) {
+    key_[0] = static_cast<uint32_t>(seed);
+    key_[1] = static_cast<uint32_t>(seed >> 32);
+    stream_ = stream;
+    block_ = 0;
+    next_ = 2;
+  }
+
+  result_type operator()() {
+    if (next_ == 2) {
+      uint32_t counter[4] = {static_cast<uint32_t>(block_), static_cast<uint32_t>(block_ >> 32),
+                             static_cast<uint32_t>(stream_), static_cast<uint32_t>(stream_ >> 32)};
+      Block(counter, key_, output_);
+      ++block_;
+      next_ = 0;
+    }
+    return output_[next_++];
+  }
+
+  // Skip count outputs.
+  void discard(unsigned long long count) {
+    while (count > 0 && next_ < 2) {
+      ++next_;
+      --count;
+    }
+    block_ += count / 2;
+    if (count % 2) {
+      operator()();
+    }
+  }
+
+  /**
+   * The 4 * 32 output bits for counter and key, after 10 rounds. Returned as two 64-bit words, low word first.
+   */
+  static void Block(const uint32_t counter[4], const uint32_t key[2], uint64_t output[2]) {
+    const uint32_t kMultiplier0 = 0xD2511F53;
+    const uint32_t kMultiplier1 = 0xCD9E8D57;
+    const uint32_t kWeyl0 = 0x9E3779B9;
+    const uint32_t kWeyl1 = 0xBB67AE85;
+    uint32_t x[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    for (int round = 0; round < 10; ++round) {
+      uint64_t product0 = static_cast<uint64_t>(kMultiplier0) * x[0];
+      uint64_t product1 = static_cast<uint64_t>(kMultiplier1) * x[2];
+      uint32_t y[4] = {static_cast<uint32_t>(product1 >> 32) ^ x[1] ^ k0, static_cast<uint32_t>(product1),
+                       static_cast<uint32_t>(product0 >> 32) ^ x[3] ^ k1, static_cast<uint32_t>(product0)};
+      x[0] = y[0];
+      x[1] = y[1];
+      x[2] = y[2];
+      x[3] = y[3];
+      k0 += kWeyl0;
+      k1 += kWeyl1;
+    }
+    output[0] = x[0] | static_cast<uint64_t>(x[1]) << 32;
+    output[1] = x[2] | static_cast<uint64_t>(x[3]) << 32;
+  }
+
+ private:
+  uint32_t key_[2];
+  uint64_t stream_;
+  uint64_t block_;  // The counter of the next block
+  uint64_t output_[2];
+  int next_;  // The next word of output_, 2 if a new block is needed
+};
+
+#endif
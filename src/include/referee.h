@@ -0,0 +1,512 @@
+/**
+ * This header file implements the referee mode: `server --referee` plays the games of a batch as a process of its own,
+ * and `client --batch --referee SERVER` (or --referee-socket PATH) drives it over pipes or a Unix domain socket.
+ *
+ * Messages are binary frames in the native byte order (both ends run on the same machine):
+ *   uint32_t size  the size of the payload
+ *   uint8_t type   a RefereeMessage
+ *   the payload    fixed-size fields, see the messages
+ * The client first sends kConfigure with the parameters of the batch, and the referee generates the maps exactly like
+ * RunBatch() does (GenerateBatchBoards()) and answers kReady. Then kStart starts a game of the batch in a slot chosen
+ * by the client, and kOperations executes the operations of Client::NextOperations() in a slot. Both are answered by
+ * kObservation: the state of the game, the blocks changed (as in CellChanges) and, once the game is over and the slot
+ * free again, the visit and marked counts.
+ *
+ * The slots are independent, so the client keeps several games in flight: while the referee executes the operations
+ * of one game, the client decides the next ones of another. Both ends only write their pending frames when they have
+ * no more frames to read without blocking, so many requests and answers share a write(2). The clients are seeded like
+ * in RunBatch() (ClientSeed()), so the results are the ones of `client --batch` with the same options.
+ */
+#ifndef REFEREE_H
+#define REFEREE_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "batch.h"
+#include "bitboard.h"
+#include "fast_io.h"
+#include "generator.h"
+#include "server.h"
+
+enum class RefereeMessage : uint8_t {
+  kConfigure = 1,    // Client: int32 rows, columns, mine_count, min_dist, first_game, games, uint64 seed, uint8 flags
+  kReady = 2,        // Referee: int32 games, once the maps are generated
+  kStart = 3,        // Client: uint32 slot, int32 game (0 to games - 1)
+  kOperations = 4,   // Client: uint32 slot, uint32 count, count * (uint16 row, uint16 column, uint8 type)
+  kObservation = 5,  // Referee: uint32 slot, int8 game_state, int32 visit_count, int32 marked_count, uint32 count,
+                     // count * (uint16 row, uint16 column, int8 value)
+  kError = 6,        // Referee: the message as text, then the referee closes the connection
+};
+
+// The flags of kConfigure.
+const uint8_t kRefereeFastGenerator = 1;
+const uint8_t kRefereeCounterRng = 2;
+const uint8_t kRefereeBitboard = 4;
+
+// The largest payload a frame may declare. kConfigure only accepts maps whose largest kObservation fits.
+const uint32_t kMaxRefereeFrame = 1 << 26;
+// The size of an operation of kOperations and of a change of kObservation.
+const size_t kRefereeBlockSize = 2 * sizeof(uint16_t) + sizeof(uint8_t);
+
+// Append a fixed-size field to a frame.
+template <class T>
+void PutField(std::string &out, T value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Start a frame of the given type in out and return its position, to pass to EndFrame() once the payload is written.
+inline size_t BeginFrame(std::string &out, RefereeMessage type) {
+  size_t start = out.size();
+  PutField<uint32_t>(out, 0);
+  PutField(out, type);
+  return start;
+}
+
+inline void EndFrame(std::string &out, size_t start) {
+  uint32_t size = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t) - sizeof(RefereeMessage));
+  std::memcpy(&out[start], &size, sizeof(size));
+}
+
+/**
+ * Read the next frame from in into type and payload (which keeps its memory). Returns false at the end of the input,
+ * or, with *too_large set if given, when the frame declares a payload larger than kMaxRefereeFrame.
+ */
+inline bool ReadFrame(FastReader &in, RefereeMessage &type, std::string &payload, bool *too_large = nullptr) {
+  uint32_t size;
+  if (!in.ReadBytes(&size, sizeof(size)) || !in.ReadBytes(&type, sizeof(type))) {
+    return false;
+  }
+  if (size > kMaxRefereeFrame) {
+    if (too_large != nullptr) {
+      *too_large = true;
+    }
+    return false;
+  }
+  payload.resize(size);
+  return in.ReadBytes(&payload[0], size);
+}
+
+/**
+ * Reads the fields of a payload in order. Reading past the end fails and leaves the field unchanged.
+ */
+class FrameCursor {
+ public:
+  explicit FrameCursor(const std::string &payload) : next_(payload.data()), end_(payload.data() + payload.size()) {}
+
+  template <class T>
+  bool Get(T &value) {
+    if (static_cast<size_t>(end_ - next_) < sizeof(value)) {
+      return false;
+    }
+    std::memcpy(&value, next_, sizeof(value));
+    next_ += sizeof(value);
+    return true;
+  }
+
+  // The count of bytes not read yet.
+  size_t Remaining() const { return static_cast<size_t>(end_ - next_); }
+
+ private:
+  const char *next_;
+  const char *end_;
+};
+
+/**
+ * Serve one client: read requests from in_fd and write the answers to out_fd until the input ends. Returns false
+ * after answering a malformed request with kError.
+ */
+inline bool ServeReferee(int in_fd, int out_fd) {
+  FastReader in(in_fd);
+  FastWriter out(out_fd);
+  BatchConfig config;
+  BoardArena arena;
+  std::unordered_map<uint32_t, MineSweeperGame> games;
+  std::unordered_map<uint32_t, BitboardGame> bitboard_games;
+  std::vector<Operation> ops;
+  RefereeMessage type;
+  std::string payload;
+  auto fail = [&out](const std::string &message) {
+    size_t frame = BeginFrame(out.Buffer(), RefereeMessage::kError);
+    out.Buffer() += message;
+    EndFrame(out.Buffer(), frame);
+    out.Flush();
+    return false;
+  };
+  // Execute ops in the game of slot and answer with its changes. The slot is freed once the game is over.
+  auto execute = [&](auto &slots, uint32_t slot) {
+    auto &game = slots.at(slot);
+    game.ExecuteBatch(ops);
+    std::string &buffer = out.Buffer();
+    size_t frame = BeginFrame(buffer, RefereeMessage::kObservation);
+    PutField(buffer, slot);
+    PutField<int8_t>(buffer, static_cast<int8_t>(game.getGameState()));
+    PutField<int32_t>(buffer, game.getVisitCount());
+    PutField<int32_t>(buffer, game.getMarkedCount());
+    PutField<uint32_t>(buffer, static_cast<uint32_t>(game.getChanges().size()));
+    for (const CellChange &change : game.getChanges()) {
+      PutField<uint16_t>(buffer, static_cast<uint16_t>(change.row));
+      PutField<uint16_t>(buffer, static_cast<uint16_t>(change.column));
+      PutField<int8_t>(buffer, static_cast<int8_t>(change.value));
+    }
+    EndFrame(buffer, frame);
+    if (game.getGameState() != 0) {
+      slots.erase(slot);
+    }
+  };
+  auto start = [&](auto &slots, uint32_t slot, int index) {
+    slots.erase(slot);
+    auto &game = slots.try_emplace(slot, arena.Rows(), arena.Columns()).first->second;
+    game.InitMap(arena.Mines(index));
+    ops.assign(1, Operation{arena.FirstRow(index), arena.FirstColumn(index), 0});
+    execute(slots, slot);
+  };
+  while (true) {
+    if (in.Buffered() == 0 && !out.Flush()) {
+      return false;
+    }
+    bool too_large = false;
+    if (!ReadFrame(in, type, payload, &too_large)) {
+      return too_large ? fail("The frame is larger than " + std::to_string(kMaxRefereeFrame) + " bytes") : true;
+    }
+    FrameCursor cursor(payload);
+    if (type == RefereeMessage::kConfigure) {
+      int32_t fields[6] = {};  // rows, columns, mine_count, min_dist, first_game, games
+      uint8_t flags = 0;
+      bool complete = true;
+      for (int32_t &field : fields) {
+        complete = complete && cursor.Get(field);
+      }
+      // The generators need a first step away from the border and room for the mines outside its min_dist.
+      if (!complete || !cursor.Get(config.seed) || !cursor.Get(flags) || fields[0] < 3 || fields[1] < 3 ||
+          fields[0] > UINT16_MAX || fields[1] > UINT16_MAX || fields[2] < 0 || fields[3] < 0 ||
+          fields[2] > int64_t{fields[0]} * fields[1] - MaxFirstStepArea(fields[0], fields[1], fields[3]) ||
+          fields[4] < 0 || fields[5] < 0) {
+        return fail("Bad kConfigure");
+      }
+      config.rows = fields[0];
+      config.columns = fields[1];
+      config.mine_count = fields[2];
+      config.min_dist = fields[3];
+      config.first_game = fields[4];
+      config.games = fields[5];
+      config.fast_generator = flags & kRefereeFastGenerator;
+      config.counter_rng = flags & kRefereeCounterRng;
+      config.bitboard = flags & kRefereeBitboard;
+      if (config.bitboard && (config.rows > BitboardGame::kMaxSize || config.columns > BitboardGame::kMaxSize)) {
+        return fail("The bitboard backend supports at most " + std::to_string(BitboardGame::kMaxSize) +
+                    " rows and columns");
+      }
+      // Every block changes at most once, so this bounds a kObservation (its other fields take less than 64 bytes).
+      if (static_cast<uint64_t>(config.rows) * config.columns * kRefereeBlockSize + 64 > kMaxRefereeFrame) {
+        return fail("The map is too large for a frame");
+      }
+      games.clear();
+      bitboard_games.clear();
+      arena.Assign(config.rows, config.columns);
+      GenerateBatchBoards(config, [&arena](const CorpusBoard &board) {
+        std::copy(board.mines, board.mines + arena.Words(), arena.Append());
+        arena.SetFirstStep(arena.Size() - 1, board.first_row, board.first_column);
+      });
+      size_t frame = BeginFrame(out.Buffer(), RefereeMessage::kReady);
+      PutField<int32_t>(out.Buffer(), arena.Size());
+      EndFrame(out.Buffer(), frame);
+    } else if (type == RefereeMessage::kStart) {
+      uint32_t slot;
+      int32_t index;
+      if (!cursor.Get(slot) || !cursor.Get(index) || index < 0 || index >= arena.Size()) {
+        return fail("Bad kStart");
+      }
+      if (config.bitboard) {
+        start(bitboard_games, slot, index);
+      } else {
+        start(games, slot, index);
+      }
+    } else if (type == RefereeMessage::kOperations) {
+      uint32_t slot;
+      uint32_t count;
+      if (!cursor.Get(slot) || !cursor.Get(count) || (config.bitboard ? bitboard_games.count(slot)
+                                                                        : games.count(slot)) == 0) {
+        return fail("Bad kOperations");
+      }
+      // The count must match the payload before anything is allocated for it.
+      if (cursor.Remaining() != count * uint64_t{kRefereeBlockSize}) {
+        return fail("Bad kOperations");
+      }
+      ops.resize(count);
+      for (Operation &op : ops) {
+        uint16_t row;
+        uint16_t column;
+        uint8_t op_type;
+        if (!cursor.Get(row) || !cursor.Get(column) || !cursor.Get(op_type) || row >= config.rows ||
+            column >= config.columns || op_type > 2) {
+          return fail("Bad kOperations");
+        }
+        op = {row, column, op_type};
+      }
+      if (config.bitboard) {
+        execute(bitboard_games, slot);
+      } else {
+        execute(games, slot);
+      }
+    } else {
+      return fail("Unexpected message " + std::to_string(static_cast<int>(type)));
+    }
+  }
+}
+
+struct RefereeStats {
+  double seconds = 0;             // From the first kStart to the last answer, without the generation of the maps
+  long long requests = 0;         // kStart and kOperations frames
+  long long operations = 0;       // Operations sent in kOperations frames
+  std::vector<double> latencies;  // The time from every request to its answer, in microseconds
+};
+
+// The value below which a fraction p of values lie (values is sorted).
+inline double Percentile(std::vector<double> &values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
+
+/**
+ * Play config.games games of a batch on a referee, reading its answers from in_fd and writing the requests to out_fd,
+ * with up to in_flight games in flight at a time, and store their results in order in results. Returns false, with a
+ * message in error, if the referee fails or the connection ends early.
+ */
+inline bool PlayReferee(const BatchConfig &config, int in_fd, int out_fd, int in_flight,
+                        std::vector<GameResult> &results, RefereeStats &stats, std::string *error) {
+  using Clock = std::chrono::steady_clock;
+  struct Slot {
+    ClientNS::Client client;
+    int index = 0;
+    Clock::time_point sent;
+    std::vector<Operation> ops;
+  };
+  FastReader in(in_fd);
+  FastWriter out(out_fd);
+  RefereeMessage type;
+  std::string payload;
+  auto receive = [&](RefereeMessage expected) {
+    if (!out.Flush() || !ReadFrame(in, type, payload)) {
+      *error = "The referee closed the connection";
+      return false;
+    }
+    if (type == RefereeMessage::kError) {
+      *error = "The referee failed: " + payload;
+      return false;
+    }
+    if (type != expected) {
+      *error = "Unexpected message " + std::to_string(static_cast<int>(type));
+      return false;
+    }
+    return true;
+  };
+  std::string &buffer = out.Buffer();
+  size_t frame = BeginFrame(buffer, RefereeMessage::kConfigure);
+  for (int32_t field : {config.rows, config.columns, config.mine_count, config.min_dist, config.first_game,
+                        config.games}) {
+    PutField(buffer, field);
+  }
+  PutField(buffer, config.seed);
+  PutField<uint8_t>(buffer, (config.fast_generator ? kRefereeFastGenerator : 0) |
+                                (config.counter_rng ? kRefereeCounterRng : 0) |
+                                (config.bitboard ? kRefereeBitboard : 0));
+  EndFrame(buffer, frame);
+  if (!receive(RefereeMessage::kReady)) {
+    return false;
+  }
+  results.assign(config.games, GameResult());
+  std::vector<Slot> slots(std::max(1, std::min(in_flight, config.games)));
+  CellChanges changes;
+  int next_game = 0;
+  int active = 0;
+  auto start = [&](uint32_t slot) {
+    Slot &s = slots[slot];
+    s.index = next_game++;
+    s.client.Reset(config.rows, config.columns, config.mine_count);
+    s.client.Seed(ClientSeed(config.seed, config.first_game + s.index));
+    s.client.SetSolverOptions(config.solver);
+    size_t start_frame = BeginFrame(buffer, RefereeMessage::kStart);
+    PutField(buffer, slot);
+    PutField<int32_t>(buffer, s.index);
+    EndFrame(buffer, start_frame);
+    s.sent = Clock::now();
+    ++stats.requests;
+  };
+  auto begin = Clock::now();
+  for (uint32_t slot = 0; slot < slots.size() && next_game < config.games; ++slot) {
+    start(slot);
+    ++active;
+  }
+  while (active > 0) {
+    // Only wait for the referee once every answer already received has been handled.
+    if (in.Buffered() == 0 && !out.Flush()) {
+      *error = "The referee closed the connection";
+      return false;
+    }
+    if (!ReadFrame(in, type, payload) || type != RefereeMessage::kObservation) {
+      *error = type == RefereeMessage::kError ? "The referee failed: " + payload : "Unexpected end of the connection";
+      return false;
+    }
+    FrameCursor cursor(payload);
+    uint32_t slot;
+    int8_t game_state;
+    int32_t visit_count;
+    int32_t marked_count;
+    uint32_t count;
+    if (!cursor.Get(slot) || slot >= slots.size() || !cursor.Get(game_state) || !cursor.Get(visit_count) ||
+        !cursor.Get(marked_count) || !cursor.Get(count) || cursor.Remaining() != count * uint64_t{kRefereeBlockSize}) {
+      *error = "Bad kObservation";
+      return false;
+    }
+    Slot &s = slots[slot];
+    stats.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - s.sent).count());
+    if (game_state != 0) {
+      GameResult &result = results[s.index];
+      result.game_state = game_state;
+      result.visit_count = visit_count;
+      result.marked_count = marked_count;
+      if (next_game < config.games) {
+        start(slot);
+      } else {
+        --active;
+      }
+      continue;
+    }
+    changes.resize(count);
+    for (CellChange &change : changes) {
+      uint16_t row;
+      uint16_t column;
+      int8_t value;
+      if (!cursor.Get(row) || !cursor.Get(column) || !cursor.Get(value)) {
+        *error = "Bad kObservation";
+        return false;
+      }
+      change = {row, column, value};
+    }
+    s.client.Observe(changes);
+    s.client.NextOperations(s.ops);
+    size_t ops_frame = BeginFrame(buffer, RefereeMessage::kOperations);
+    PutField(buffer, slot);
+    PutField<uint32_t>(buffer, static_cast<uint32_t>(s.ops.size()));
+    for (const Operation &op : s.ops) {
+      PutField<uint16_t>(buffer, static_cast<uint16_t>(op.row));
+      PutField<uint16_t>(buffer, static_cast<uint16_t>(op.column));
+      PutField<uint8_t>(buffer, static_cast<uint8_t>(op.type));
+    }
+    EndFrame(buffer, ops_frame);
+    s.sent = Clock::now();
+    ++stats.requests;
+    stats.operations += static_cast<long long>(s.ops.size());
+  }
+  stats.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+  return true;
+}
+
+/**
+ * Start `path --referee` with its standard input and output connected to pipes: requests go to to_referee and the
+ * answers come from from_referee. Returns the pid of the referee, or -1 if it cannot be started.
+ */
+inline pid_t SpawnReferee(const std::string &path, int &to_referee, int &from_referee) {
+  int requests[2];
+  int answers[2];
+  if (pipe(requests) != 0) {
+    return -1;
+  }
+  if (pipe(answers) != 0) {
+    close(requests[0]);
+    close(requests[1]);
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(requests[0], 0);
+    dup2(answers[1], 1);
+    for (int fd : {requests[0], requests[1], answers[0], answers[1]}) {
+      close(fd);
+    }
+    execl(path.c_str(), path.c_str(), "--referee", static_cast<char *>(nullptr));
+    _exit(127);
+  }
+  close(requests[0]);
+  close(answers[1]);
+  if (pid < 0) {
+    close(requests[1]);
+    close(answers[0]);
+    return -1;
+  }
+  to_referee = requests[1];
+  from_referee = answers[0];
+  return pid;
+}
+
+// Fill address with a Unix domain socket path. Returns false if the path is too long.
+inline bool RefereeAddress(const std::string &path, sockaddr_un &address) {
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+/**
+ * Connect to a referee listening on the Unix domain socket at path. Returns the socket, or -1.
+ */
+inline int ConnectReferee(const std::string &path) {
+  sockaddr_un address;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (!RefereeAddress(path, address) || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Listen on a Unix domain socket at path (replacing a stale one) and serve the clients that connect, one after the
+ * other, until accept() fails. Returns false if the socket cannot be created.
+ */
+inline bool ListenReferee(const std::string &path) {
+  sockaddr_un address;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  unlink(path.c_str());
+  if (!RefereeAddress(path, address) || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, 16) != 0) {
+    close(fd);
+    return false;
+  }
+  while (true) {
+    int connection = accept(fd, nullptr, nullptr);
+    if (connection < 0) {
+      break;
+    }
+    ServeReferee(connection, connection);
+    close(connection);
+  }
+  close(fd);
+  return true;
+}
+
+#endif
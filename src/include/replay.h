@@ -0,0 +1,436 @@
+/**
+ * This header file implements the replay log: a binary record of every game of a batch (`client --batch --record`)
+ * that the `replay` tool plays back through the server alone, without a client and without rendering anything.
+ *
+ * A replay log is little-endian and consists of
+ *   ReplayHeader                        the magic "MSREPLAY", the version, the number of games and the index offset
+ *   a record for every game             ReplayGameHeader (size, first step, result, seed and index of the run), the
+ *                                       mines packed like a corpus board (see corpus.h), then the operations after the
+ *                                       first step, padded with zeros to a multiple of 8 bytes
+ *   the index                           the offset of every record, as uint64_t
+ * Every operation is one varint (7 bits per byte, low bits first) of zigzag(block - previous block) << 2 | type, where
+ * block is row * columns + column and the previous block of the first operation is the first step: the operations
+ * of a client mostly stay close to the previous one, so most take one or two bytes.
+ *
+ * The mines are stored with the seed and index of the game, so that a game can be replayed without generating the
+ * boards before it. A log whose writer did not get to Close() has no index; ReplayReader then finds the records by
+ * scanning them.
+ */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "corpus.h"
+#include "observation.h"
+
+struct ReplayHeader {
+  char magic[8];  // "MSREPLAY"
+  uint32_t version;
+  uint32_t header_size;  // sizeof(ReplayHeader)
+  uint64_t game_count;
+  uint64_t index_offset;  // Where the index starts, 0 while the file is being written
+};
+
+struct ReplayGameHeader {
+  uint32_t rows;
+  uint32_t columns;
+  int32_t first_row;
+  int32_t first_column;
+  int32_t game_state;  // The result of the game: 1 for winning, -1 for losing
+  uint32_t visit_count;
+  uint32_t marked_count;
+  uint32_t operation_count;  // The operations after the first step
+  uint64_t seed;
+  uint64_t index;
+  uint32_t operation_bytes;  // The size of the operations, without the padding
+  uint32_t reserved;
+};
+
+const char kReplayMagic[8] = {'M', 'S', 'R', 'E', 'P', 'L', 'A', 'Y'};
+const uint32_t kReplayVersion = 1;
+
+/**
+ * Record one game: Start() once the map is loaded, Add() every operation executed (the first step included), and
+ * Finish() at the end of the game. Record() is then the record to append to a log with ReplayWriter::Add().
+ */
+class ReplayRecorder {
+ public:
+  ReplayRecorder(uint64_t seed, uint64_t index) : seed_(seed), index_(index) {}
+
+  template <class Game>
+  void Start(const Game &game) {
+    header_ = ReplayGameHeader();
+    header_.rows = game.getRows();
+    header_.columns = game.getColumns();
+    header_.seed = seed_;
+    header_.index = index_;
+    mines_.assign(CorpusWords(game.getRows(), game.getColumns()), 0);
+    for (int r = 0; r < game.getRows(); ++r) {
+      for (int c = 0; c < game.getColumns(); ++c) {
+        if (game.isMine(r, c)) {
+          size_t block = static_cast<size_t>(r) * game.getColumns() + c;
+          mines_[block >> 6] |= 1ULL << (block & 63);
+        }
+      }
+    }
+    operations_.clear();
+    started_ = false;
+  }
+
+  void Add(const Operation &op) {
+    int64_t block = static_cast<int64_t>(op.row) * header_.columns + op.column;
+    if (!started_) {
+      header_.first_row = op.row;
+      header_.first_column = op.column;
+      previous_ = block;
+      started_ = true;
+      return;
+    }
+    int64_t delta = block - previous_;
+    uint64_t zigzag = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+    uint64_t value = zigzag << 2 | static_cast<uint64_t>(op.type & 3);
+    while (value >= 0x80) {
+      operations_.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    operations_.push_back(static_cast<char>(value));
+    previous_ = block;
+    ++header_.operation_count;
+  }
+
+  template <class Game>
+  void Finish(Game &game) {
+    header_.game_state = game.getGameState();
+    header_.visit_count = game.getVisitCount();
+    header_.marked_count = game.getMarkedCount();
+    header_.operation_bytes = static_cast<uint32_t>(operations_.size());
+    record_.assign(reinterpret_cast<const char *>(&header_), sizeof(header_));
+    record_.append(reinterpret_cast<const char *>(mines_.data()), mines_.size() * sizeof(uint64_t));
+    record_ += operations_;
+    record_.append((8 - record_.size() % 8) % 8, '\0');
+  }
+
+  const std::string &Record() const { return record_; }
+
+ private:
+  uint64_t seed_;
+  uint64_t index_;
+  ReplayGameHeader header_ = ReplayGameHeader();
+  std::vector<uint64_t> mines_;
+  std::string operations_;
+  int64_t previous_ = 0;
+  bool started_ = false;
+  std::string record_;
+};
+
+/**
+ * Write a replay log. The records of a batch can be added from any thread in any order: every record is added with
+ * its position in the log, and written as soon as the records before it are. The index is written by Close().
+ */
+class ReplayWriter {
+ public:
+  ReplayWriter() : file_(nullptr), offset_(0), ok_(true) {}
+  ~ReplayWriter() { Close(); }
+  ReplayWriter(const ReplayWriter &) = delete;
+  ReplayWriter &operator=(const ReplayWriter &) = delete;
+
+  bool Open(const std::string &path) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      return false;
+    }
+    ReplayHeader header = {};
+    std::memcpy(header.magic, kReplayMagic, sizeof(header.magic));
+    header.version = kReplayVersion;
+    header.header_size = sizeof(ReplayHeader);
+    offset_ = 0;
+    offsets_.clear();
+    pending_.clear();
+    ok_ = Write(&header, sizeof(header));
+    return ok_;
+  }
+
+  // Add the record of the game at position (0 for the first game of the log) once every position before it is added.
+  void Add(size_t position, const std::string &record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (position != offsets_.size()) {
+      pending_[position] = record;
+      return;
+    }
+    Append(record);
+    for (auto next = pending_.begin(); next != pending_.end() && next->first == offsets_.size();
+         next = pending_.erase(next)) {
+      Append(next->second);
+    }
+  }
+
+  int Size() const { return static_cast<int>(offsets_.size()); }
+
+  // Write the index and the header. Returns false if anything could not be written or a position is missing.
+  bool Close() {
+    if (file_ == nullptr) {
+      return false;
+    }
+    ReplayHeader header = {};
+    std::memcpy(header.magic, kReplayMagic, sizeof(header.magic));
+    header.version = kReplayVersion;
+    header.header_size = sizeof(ReplayHeader);
+    header.game_count = offsets_.size();
+    header.index_offset = offset_;
+    bool ok = ok_ && pending_.empty() && Write(offsets_.data(), offsets_.size() * sizeof(uint64_t));
+    ok = ok && std::fseek(file_, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file_) == 1;
+    ok = std::fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    return ok;
+  }
+
+ private:
+  void Append(const std::string &record) {
+    offsets_.push_back(offset_);
+    ok_ = Write(record.data(), record.size()) && ok_;
+  }
+
+  bool Write(const void *data, size_t size) {
+    offset_ += size;
+    return size == 0 || std::fwrite(data, size, 1, file_) == 1;
+  }
+
+  std::FILE *file_;
+  uint64_t offset_;
+  bool ok_;
+  std::vector<uint64_t> offsets_;
+  std::map<size_t, std::string> pending_;  // The records added before the ones before them
+  std::mutex mutex_;
+};
+
+/**
+ * One game of a replay log. mines and operations point into the mapped file.
+ */
+struct ReplayGame {
+  const ReplayGameHeader *header = nullptr;
+  const uint64_t *mines = nullptr;
+  const unsigned char *operations = nullptr;
+  const unsigned char *operations_end = nullptr;
+};
+
+/**
+ * Decode the operations of a game in order, the first step first.
+ */
+class ReplayDecoder {
+ public:
+  explicit ReplayDecoder(const ReplayGame &game)
+      : next_(game.operations), end_(game.operations_end), columns_(game.header->columns),
+        previous_(static_cast<int64_t>(game.header->first_row) * game.header->columns + game.header->first_column),
+        first_(true) {}
+
+  // The next operation. Returns false after the last one, or if the operations are truncated.
+  bool Next(Operation &op) {
+    if (first_) {
+      first_ = false;
+      op = {static_cast<int>(previous_ / columns_), static_cast<int>(previous_ % columns_), 0};
+      return true;
+    }
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+      if (next_ == end_ || shift > 63) {
+        return false;
+      }
+      unsigned char byte = *next_++;
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+    }
+    uint64_t zigzag = value >> 2;
+    previous_ += static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+    op = {static_cast<int>(previous_ / columns_), static_cast<int>(previous_ % columns_), static_cast<int>(value & 3)};
+    return true;
+  }
+
+ private:
+  const unsigned char *next_;
+  const unsigned char *end_;
+  int64_t columns_;
+  int64_t previous_;
+  bool first_;
+};
+
+/**
+ * Read a replay log mapped into memory. Games can be accessed in any order and from any thread.
+ */
+class ReplayReader {
+ public:
+  ReplayReader() : data_(nullptr), size_(0) {}
+  ~ReplayReader() { Close(); }
+  ReplayReader(const ReplayReader &) = delete;
+  ReplayReader &operator=(const ReplayReader &) = delete;
+
+  /**
+   * Map the file at path. Returns false (and writes the reason to error if given) if it cannot be read or is not a
+   * valid replay log.
+   */
+  bool Open(const std::string &path, std::string *error = nullptr) {
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return Fail(error, "cannot open " + path);
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(ReplayHeader))) {
+      ::close(fd);
+      return Fail(error, path + " is too small to be a replay log");
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      size_ = 0;
+      return Fail(error, "cannot map " + path);
+    }
+    data_ = static_cast<const unsigned char *>(data);
+    const ReplayHeader *header = reinterpret_cast<const ReplayHeader *>(data_);
+    if (std::memcmp(header->magic, kReplayMagic, sizeof(kReplayMagic)) != 0 || header->version != kReplayVersion ||
+        header->header_size != sizeof(ReplayHeader)) {
+      Close();
+      return Fail(error, path + " is not a replay log of version " + std::to_string(kReplayVersion));
+    }
+    uint64_t end = header->index_offset;
+    if (end == 0) {
+      // No index: every complete record up to the end of the file.
+      end = size_;
+      uint64_t offset = sizeof(ReplayHeader);
+      for (; RecordSize(offset, end) > 0; offset += RecordSize(offset, end)) {
+        index_.push_back(offset);
+      }
+      if (offset + sizeof(ReplayGameHeader) <= end && !RecordValid(offset)) {
+        size_t game = index_.size();
+        Close();
+        return Fail(error, path + " has a bad game " + std::to_string(game));
+      }
+    } else {
+      if (end % 8 != 0 || end > size_ || (size_ - end) / sizeof(uint64_t) < header->game_count) {
+        Close();
+        return Fail(error, path + " is truncated");
+      }
+      const uint64_t *index = reinterpret_cast<const uint64_t *>(data_ + end);
+      index_.assign(index, index + header->game_count);
+    }
+    for (size_t i = 0; i < index_.size(); ++i) {
+      if (index_[i] % 8 != 0 || RecordSize(index_[i], end) == 0) {
+        Close();
+        return Fail(error, path + " has a bad game " + std::to_string(i));
+      }
+    }
+    ::madvise(const_cast<unsigned char *>(data_), size_, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  void Close() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<unsigned char *>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    index_.clear();
+  }
+
+  int Size() const { return static_cast<int>(index_.size()); }
+
+  // Whether the log was closed by its writer, i.e. has an index.
+  bool Indexed() const { return reinterpret_cast<const ReplayHeader *>(data_)->index_offset != 0; }
+
+  ReplayGame Game(int i) const {
+    ReplayGame game;
+    game.header = reinterpret_cast<const ReplayGameHeader *>(data_ + index_[i]);
+    game.mines = reinterpret_cast<const uint64_t *>(game.header + 1);
+    game.operations = reinterpret_cast<const unsigned char *>(game.mines + MineWords(*game.header));
+    game.operations_end = game.operations + game.header->operation_bytes;
+    return game;
+  }
+
+ private:
+  static size_t MineWords(const ReplayGameHeader &header) { return CorpusWords(header.rows, header.columns); }
+
+  // Whether the header of the record at offset describes a board that can be played (see CorpusBoardValid()).
+  bool RecordValid(uint64_t offset) const {
+    const ReplayGameHeader *header = reinterpret_cast<const ReplayGameHeader *>(data_ + offset);
+    return CorpusBoardValid(header->rows, header->columns, header->first_row, header->first_column);
+  }
+
+  // The size of the record at offset with its padding, or 0 if it does not fit before end or is not valid.
+  size_t RecordSize(uint64_t offset, uint64_t end) const {
+    if (offset + sizeof(ReplayGameHeader) > end || !RecordValid(offset)) {
+      return 0;
+    }
+    const ReplayGameHeader *header = reinterpret_cast<const ReplayGameHeader *>(data_ + offset);
+    uint64_t size = sizeof(ReplayGameHeader) + MineWords(*header) * sizeof(uint64_t) + header->operation_bytes;
+    size = (size + 7) / 8 * 8;
+    return offset + size <= end ? size : 0;
+  }
+
+  static bool Fail(std::string *error, const std::string &message) {
+    if (error != nullptr) {
+      *error = message;
+    }
+    return false;
+  }
+
+  const unsigned char *data_;
+  size_t size_;
+  std::vector<uint64_t> index_;
+};
+
+/**
+ * The outcome of replaying a game: whether it ended exactly at its last operation with the recorded result.
+ */
+struct ReplayCheck {
+  bool ok = false;
+  long long operations = 0;  // The operations executed
+  int game_state = 0;
+  int visit_count = 0;
+  int marked_count = 0;
+};
+
+/**
+ * Replay a game of a log on a fresh Game (MineSweeperGame or BitboardGame) with Execute(), and compare the result with
+ * the recorded one.
+ */
+template <class Game>
+ReplayCheck ReplayOne(const ReplayGame &record) {
+  const ReplayGameHeader &header = *record.header;
+  Game game(header.rows, header.columns);
+  game.InitMap(record.mines);
+  ReplayDecoder decoder(record);
+  ReplayCheck check;
+  Operation op;
+  bool early = false;  // The game ended before the last operation
+  while (decoder.Next(op)) {
+    if (game.getGameState() != 0) {
+      early = true;
+      break;
+    }
+    game.Execute(op.row, op.column, op.type);
+    ++check.operations;
+  }
+  check.game_state = game.getGameState();
+  check.visit_count = game.getVisitCount();
+  check.marked_count = game.getMarkedCount();
+  check.ok = !early && check.operations == static_cast<long long>(header.operation_count) + 1 &&
+             check.game_state == header.game_state && check.visit_count == static_cast<int>(header.visit_count) &&
+             check.marked_count == static_cast<int>(header.marked_count);
+  return check;
+}
+
+#endif
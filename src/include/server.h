@@ -1,82 +1,161 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
-const int dx[] = {0, 0, 1, -1, 1, -1, 1, -1};  // The relative x coordinates of the 8 adjacent blocks
-const int dy[] = {1, -1, 0, 0, 1, -1, -1, 1};  // The relative y coordinates of the 8 adjacent blocks
+#include "board.h"
+#include "metrics.h"
+#include "neighbours.h"
+#include "observation.h"
 
 int rows;
 int columns;
 int total_mines;
 int game_state;  // The state of the game, 0 for continuing, 1 for winning, -1 for losing. You MUST NOT modify its name.
 
+/**
+ * @brief One game of Minesweeper.
+ *
+ * @details All the state of a game, including its size and game state, lives in the instance, so several games can be
+ * played at the same time (e.g. by the batch runner in batch.h). The global functions below operate on the global game
+ * and keep the global variables above in sync with it.
+ */
 class MineSweeperGame {
 private:
-    bool map[35][35];  // 1 - mine, 0 - no mine
-    bool visited[35][35];  // 1 - visited, 0 - not visited
-    bool marked[35][35];  // 1 - marked, 0 - not marked
-    int mine_count[35][35];  // The number of mines around a block
+    int rows;
+    int columns;
+    int total_mines;
+    int game_state;  // 0 for continuing, 1 for winning, -1 for losing
+    // The blocks share one padded layout (see PaddedGrid), so a padded index addresses the same block in all of them.
+    // The border reads as visited, neither a mine nor marked, with mine count 0, which stops the neighbour loops.
+    PaddedGrid<bool> map;  // 1 - mine, 0 - no mine
+    PaddedGrid<bool> visited;  // 1 - visited, 0 - not visited
+    PaddedGrid<bool> marked;  // 1 - marked, 0 - not marked
+    PaddedGrid<unsigned char> mine_count;  // The number of mines around a block
     int marked_count;  // The number of blocks marked as mines
     int visit_count;  // The number of blocks visited
+    CellChanges changes;  // The blocks changed by the current operation, see GetChanges()
+    std::vector<int> cascade;  // The blocks with mine count 0 whose neighbours VisitBlock() still has to visit (padded)
+
+    void RecordChange(int r, int c) {
+        changes.push_back({r, c, VisibleValue(r, c)});
+    }
+
+    void PlaceMine(int r, int c) {
+        map[r][c] = true;
+        total_mines++;
+    }
+
+    // Compute the mine count of every block once all the mines are placed, with the kernels of neighbours.h.
+    void CountMines() {
+        CountNeighbours(map[0], map.Stride(), rows, columns, mine_count[0], mine_count.Stride(),
+                        ActiveNeighbourKernel());
+    }
+
+    // Count a visited block without mine. Returns true if the player wins.
+    bool CountVisit() {
+        visit_count++;
+        if(visit_count == rows * columns - total_mines) {
+            game_state = 1;
+            return true;
+        }
+        return false;
+    }
 
 public:
-    MineSweeperGame() {}
-    MineSweeperGame(int r, int c) : visit_count(0), marked_count(0) {
+    MineSweeperGame() : MineSweeperGame(0, 0) {}
+    MineSweeperGame(int r, int c) { Reset(r, c); }
+
+    /**
+     * Start over with an empty r * c map, as MineSweeperGame(r, c) but in place: the memory of the blocks is reused if
+     * the padded map is not larger than before, so a pooled game (see SessionTable in session.h) never allocates again.
+     */
+    void Reset(int r, int c) {
         rows = r;
         columns = c;
+        total_mines = 0;
         game_state = 0;
-        for(int i = 0; i < rows; i++) {
-            for(int j = 0; j < columns; j++) {
-                map[i][j] = false;
-                visited[i][j] = false;
-                marked[i][j] = false;
-                mine_count[i][j] = 0;
-            }
-        }
+        marked_count = 0;
+        visit_count = 0;
+        map.Assign(rows, columns, false);
+        visited.Assign(rows, columns, false, true);
+        marked.Assign(rows, columns, false);
+        mine_count.Assign(rows, columns, 0);
+        changes.clear();
     }
 
-    void InitMap() {
+    void InitMap(std::istream &in = std::cin) {
         char ch;
         for(int i = 0; i < rows; i++) {
             for(int j = 0; j < columns; j++) {
-                std::cin >> ch;
+                in >> ch;
                 if(ch == 'X') {
-                    map[i][j] = true;
-                    total_mines++;
-                    for(int k = 0; k < 8; k++) {
-                        int x = i + dx[k];
-                        int y = j + dy[k];
-                        if(x >= 0 && x < rows && y >= 0 && y < columns) {
-                            mine_count[x][y]++;
-                        }
-                    }
+                    PlaceMine(i, j);
                 }
             }
         }
+        CountMines();
     }
 
+    /**
+     * Initialize the map from packed bits instead of text: bit r * columns + c of mines is set for a mine (the format
+     * of BoardArena in generator.h).
+     */
+    void InitMap(const uint64_t *mines) {
+        size_t words = (static_cast<size_t>(rows) * columns + 63) / 64;
+        for(size_t w = 0; w < words; w++) {
+            for(uint64_t bits = mines[w]; bits; bits &= bits - 1) {
+                size_t block = w * 64 + __builtin_ctzll(bits);
+                PlaceMine(block / columns, block % columns);
+            }
+        }
+        CountMines();
+    }
+
+    /**
+     * Visit a block. If its mine count is 0, its neighbours are visited too, and so on. The blocks waiting for their
+     * neighbours to be visited are kept in an explicit stack instead of recursion, so the depth does not grow with the
+     * size of the open area.
+     */
     void VisitBlock(int r, int c) {
         if(r < 0 || r >= rows || c < 0 || c >= columns || marked[r][c] || visited[r][c]) {
             return;
         }
         visited[r][c] = true;
+        RecordChange(r, c);
         if(map[r][c]) {
             game_state = -1;
             return;
         }
-        visit_count++;
-        if(visit_count == rows * columns - total_mines) {
-            game_state = 1;
+        METRICS_CASCADE(visit_count);
+        if(CountVisit()) {
             return;
         }
+        cascade.clear();
         if(!mine_count[r][c]) {
-            for(int i = 0; i < 8; i++) {
-                int x = r + dx[i];
-                int y = c + dy[i];
-                if(x >= 0 && x < rows && y >= 0 && y < columns && !visited[x][y]) {
-                    VisitBlock(x, y);
+            cascade.push_back(visited.Index(r, c));
+        }
+        while(!cascade.empty()) {
+            int block = cascade.back();
+            cascade.pop_back();
+            // The border is visited, so the neighbours need no bounds check.
+            for(int offset : visited.Offsets()) {
+                int next = block + offset;
+                if(visited.At(next) || marked.At(next)) {
+                    continue;
+                }
+                // Blocks next to a block with mine count 0 are never mines.
+                visited.At(next) = true;
+                RecordChange(visited.Row(next), visited.Column(next));
+                if(CountVisit()) {
+                    return;
+                }
+                if(!mine_count.At(next)) {
+                    cascade.push_back(next);
                 }
             }
         }
@@ -87,6 +166,7 @@ public:
             return;
         }
         marked[r][c] = true;
+        RecordChange(r, c);
         if(map[r][c]) {
             marked_count++;
         } else {
@@ -98,74 +178,163 @@ public:
         if(r < 0 || r >= rows || c < 0 || c >= columns || !visited[r][c] || map[r][c]) {
             return;
         }
+        // The border is neither marked nor unvisited, so the neighbours need no bounds check.
+        int block = marked.Index(r, c);
         int cnt = 0;
-        for(int i = 0; i < 8; i++) {
-            int x = r + dx[i];
-            int y = c + dy[i];
-            if(x >= 0 && x < rows && y >= 0 && y < columns && marked[x][y]) {
-                cnt++;
-            }
+        for(int offset : marked.Offsets()) {
+            cnt += marked.At(block + offset);
         }
         if(cnt == mine_count[r][c]) {
             for(int i = 0; i < 8; i++) {
-                int x = r + dx[i];
-                int y = c + dy[i];
-                if(x >= 0 && x < rows && y >= 0 && y < columns && !visited[x][y] && !marked[x][y]) {
-                    VisitBlock(x, y);
+                int next = block + marked.Offsets()[i];
+                if(!visited.At(next) && !marked.At(next)) {
+                    VisitBlock(r + kNeighbourRow[i], c + kNeighbourColumn[i]);
                 }
             }
         }
     }
 
-    void PrintMap() {
+    void PrintMap(std::ostream &out = std::cout) {
         for(int i = 0; i < rows; i++) {
             for(int j = 0; j < columns; j++) {
                 if(visited[i][j] || marked[i][j]) {
                     if(marked[i][j]) {
-                        std::cout << "@";
+                        out << "@";
                     } else {
-                        std::cout << mine_count[i][j];
+                        out << static_cast<int>(mine_count[i][j]);
                     }
                 } else {
-                    std::cout << "?";
+                    out << "?";
                 }
             }
-            std::cout << std::endl;
+            out << std::endl;
         }
     }
 
-    void PrintMap_win() {
+    void PrintMap_win(std::ostream &out = std::cout) {
         for(int i = 0; i < rows; i++) {
             for(int j = 0; j < columns; j++) {
                 if(map[i][j]) {
-                    std::cout << "@";
+                    out << "@";
                 } else {
-                    std::cout << mine_count[i][j];
+                    out << static_cast<int>(mine_count[i][j]);
                 }
             }
-            std::cout << std::endl;
+            out << std::endl;
         }
     }
 
-    void PrintMap_lose() {
+    void PrintMap_lose(std::ostream &out = std::cout) {
         for(int i = 0; i < rows; i++) {
             for(int j = 0; j < columns; j++) {
                 if(visited[i][j] || marked[i][j]) {
                     if((map[i][j] && visited[i][j]) || (!map[i][j] && marked[i][j])) {
-                        std::cout << "X";
+                        out << "X";
                     } else if(map[i][j]) {
-                        std::cout << "@";
+                        out << "@";
                     } else {
-                        std::cout << mine_count[i][j];
+                        out << static_cast<int>(mine_count[i][j]);
                     }
                 } else {
-                    std::cout << "?";
+                    out << "?";
                 }
             }
-            std::cout << std::endl;
+            out << std::endl;
         }
     }
 
+    /**
+     * Append the map to out, a line per row, exactly as PrintMap() (state 0), PrintMap_win() (state 1) or
+     * PrintMap_lose() (state -1) print it. The rows are written in place into out, which is grown once, so this costs
+     * no stream operation per block (see `server --fast` in basic.cpp).
+     */
+    void RenderMap(std::string &out, int state) const {
+        size_t offset = out.size();
+        out.resize(offset + static_cast<size_t>(rows) * (columns + 1));
+        char *line = &out[offset];
+        for(int i = 0; i < rows; i++) {
+            for(int j = 0; j < columns; j++) {
+                line[j] = BlockChar(i, j, state);
+            }
+            line[columns] = '\n';
+            line += columns + 1;
+        }
+    }
+
+    // The character of block (r, c) in RenderMap().
+    char BlockChar(int r, int c, int state) const {
+        char count = static_cast<char>('0' + mine_count[r][c]);
+        if(state == 1) {
+            return map[r][c] ? '@' : count;
+        }
+        if(!visited[r][c] && !marked[r][c]) {
+            return '?';
+        }
+        if(state == -1) {
+            if((map[r][c] && visited[r][c]) || (!map[r][c] && marked[r][c])) {
+                return 'X';
+            }
+            return map[r][c] ? '@' : count;
+        }
+        return marked[r][c] ? '@' : count;
+    }
+
+    /**
+     * The content of a block as PrintMap() shows it while the game continues: -1 for '?', -2 for '@' and the mine
+     * count for a visited block.
+     */
+    int VisibleValue(int r, int c) const {
+        if(marked[r][c]) {
+            return -2;
+        }
+        return visited[r][c] ? mine_count[r][c] : -1;
+    }
+
+    // Start recording a new operation. The changes of the previous operation are dropped.
+    void BeginOperation() { changes.clear(); }
+    const CellChanges &getChanges() const { return changes; }
+
+    /**
+     * Execute an operation: 0 for VisitBlock(r, c), 1 for MarkMine(r, c) and 2 for AutoExplore(r, c). It starts a new
+     * operation, so getChanges() returns the blocks changed by it afterwards.
+     */
+    void Execute(int r, int c, int type) {
+        BeginOperation();
+        if(type == 0) {
+            VisitBlock(r, c);
+        } else if(type == 1) {
+            MarkMine(r, c);
+        } else if(type == 2) {
+            AutoExplore(r, c);
+        }
+    }
+
+    /**
+     * Execute ops in order as a single operation, stopping after the first one that ends the game, and return the
+     * number of operations executed. getChanges() returns the blocks changed by all of them in order, so applying
+     * them gives the same map as applying the changes of every operation in turn.
+     */
+    size_t ExecuteBatch(const std::vector<Operation> &ops) {
+        BeginOperation();
+        size_t executed = 0;
+        while(executed < ops.size() && game_state == 0) {
+            const Operation &op = ops[executed++];
+            if(op.type == 0) {
+                VisitBlock(op.row, op.column);
+            } else if(op.type == 1) {
+                MarkMine(op.row, op.column);
+            } else if(op.type == 2) {
+                AutoExplore(op.row, op.column);
+            }
+        }
+        return executed;
+    }
+
+    int getRows() const { return rows; }
+    int getColumns() const { return columns; }
+    int getTotalMines() const { return total_mines; }
+    int getGameState() const { return game_state; }
+    bool isMine(int r, int c) const { return map[r][c]; }
     int getVisitCount() { return visit_count; }
     int getMarkedCount() { return game_state == 1 ? total_mines : marked_count; }
 
@@ -189,6 +358,8 @@ void InitMap() {
     std::cin >> rows >> columns;
     game = MineSweeperGame(rows, columns);
     game.InitMap();
+    total_mines = game.getTotalMines();
+    game_state = game.getGameState();
 }
 
 /**
@@ -222,7 +393,9 @@ void InitMap() {
  * @note For invalid operation, you should not do anything.
  */
 void VisitBlock(int r, int c) {
+    game.BeginOperation();
     game.VisitBlock(r, c);
+    game_state = game.getGameState();
 }
 
 /**
@@ -259,7 +432,9 @@ void VisitBlock(int r, int c) {
  * @note For invalid operation, you should not do anything.
  */
 void MarkMine(int r, int c) {
+    game.BeginOperation();
     game.MarkMine(r, c);
+    game_state = game.getGameState();
 }
 
 /**
@@ -279,7 +454,21 @@ void MarkMine(int r, int c) {
  * And the game ends (and player wins).
  */
 void AutoExplore(int r, int c) {
+    game.BeginOperation();
     game.AutoExplore(r, c);
+    game_state = game.getGameState();
+}
+
+/**
+ * @brief The definition of function ExecuteOperations(const std::vector<Operation> &)
+ *
+ * @details This function executes a list of operations in order as a single operation, stopping after the first one
+ * that ends the game. The game ends exactly as if VisitBlock(), MarkMine() and AutoExplore() were called one at a
+ * time, but GetChanges() and PrintChanges() afterwards report the changes of all of them at once.
+ */
+void ExecuteOperations(const std::vector<Operation> &ops) {
+    game.ExecuteBatch(ops);
+    game_state = game.getGameState();
 }
 
 /**
@@ -331,4 +520,34 @@ void PrintMap() {
     }
 }
 
+/**
+ * @brief The definition of function GetChanges()
+ *
+ * @details This function returns the blocks whose content changed during the last call of VisitBlock(), MarkMine() or
+ * AutoExplore(), in the order they changed. It is a typed alternative to PrintMap(): applying these changes to the
+ * previous map gives exactly the map PrintMap() would print while the game continues, without formatting and parsing
+ * every block.
+ */
+const CellChanges &GetChanges() {
+    return game.getChanges();
+}
+
+/**
+ * @brief The definition of function PrintChanges()
+ *
+ * @details This function is the delta alternative to PrintMap(): it prints only the blocks changed by the last
+ * operation and the game state (see FormatChanges() in observation.h). If you call VisitBlock(2, 0) on the 3 * 3 map
+ * above and PrintChanges() after that, the stdout would be
+ *    4 0
+ *    2 0 0
+ *    2 1 1
+ *    1 0 1
+ *    1 1 2
+ */
+void PrintChanges() {
+    std::string out;
+    FormatChanges(out, game.getChanges(), game_state);
+    std::cout << out << std::flush;
+}
+
 #endif
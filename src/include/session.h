@@ -0,0 +1,224 @@
+/**
+ * This header file implements the multi-session mode of the server: `server --sessions N` hosts up to N games at the
+ * same time over one connection, where the other modes play the one global game of server.h and exit with it.
+ *
+ * Requests are text lines, answered in order:
+ *   open ROWS COLUMNS   followed by the map as InitMap() reads it (ROWS * COLUMNS characters, 'X' for a mine). Opens
+ *                       a session and answers "ID 0 0": the id of the session and the empty delta of the new map.
+ *   ID ROW COLUMN TYPE  executes operation TYPE (0, 1 or 2 as in Execute()) on block (ROW, COLUMN) of session ID and
+ *                       answers "ID " followed by the delta output of FormatChanges(). Once the game is over, the line
+ *                       "visit_count marked_count" of ExitGame() follows and the session is closed.
+ *   close ID            closes session ID before its game is over, answers "ID closed".
+ *   stats               answers "sessions LIVE CAPACITY".
+ * A request that cannot be served (the table is full, the map is too large, the session is not open) is answered
+ * "error MESSAGE" and the connection goes on. Only an input that cannot be parsed ends it.
+ *
+ * The games live in SessionTable, a pool of MineSweeperGame allocated once for the largest map the server accepts. A
+ * session takes a free game of the pool, which MineSweeperGame::Reset() reuses, and gives it back when it is closed:
+ * once the buffers of the changes of every game have grown to its largest operation, neither opening sessions nor
+ * playing them allocates. An id combines the slot of the game with a generation that changes every time the slot is
+ * recycled, so a stale id is rejected instead of reaching the next game of its slot.
+ */
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fast_io.h"
+#include "observation.h"
+#include "server.h"
+
+class SessionTable {
+ public:
+  static const int kSlotBits = 20;
+  static const int kMaxCapacity = 1 << kSlotBits;
+  static const int kGenerations = 1 << (31 - kSlotBits);  // So that ids are non-negative ints
+
+  // A pool of capacity (at most kMaxCapacity) games for maps of at most max_rows * max_columns, allocated at once.
+  SessionTable(int capacity, int max_rows, int max_columns)
+      : max_rows_(max_rows),
+        max_columns_(max_columns),
+        games_(capacity, MineSweeperGame(max_rows, max_columns)),
+        generations_(capacity, 0),
+        live_(capacity, false) {
+    free_.reserve(capacity);
+    for (int slot = capacity - 1; slot >= 0; --slot) {
+      free_.push_back(slot);
+    }
+  }
+
+  /**
+   * Open a session with an empty rows * columns map (see MineSweeperGame::InitMap() to place the mines). Returns its
+   * id, or -1 if every game is in use or the map is larger than the pool allows.
+   */
+  int Open(int rows, int columns) {
+    if (free_.empty() || rows < 1 || columns < 1 || rows > max_rows_ || columns > max_columns_) {
+      return -1;
+    }
+    int slot = free_.back();
+    free_.pop_back();
+    live_[slot] = true;
+    games_[slot].Reset(rows, columns);
+    return generations_[slot] << kSlotBits | slot;
+  }
+
+  // The game of session id, or nullptr if no open session has this id.
+  MineSweeperGame *Find(int id) {
+    int slot = id & (kMaxCapacity - 1);
+    if (id < 0 || slot >= Capacity() || !live_[slot] || generations_[slot] != id >> kSlotBits) {
+      return nullptr;
+    }
+    return &games_[slot];
+  }
+
+  // Close session id, which must be open, and recycle its game.
+  void Close(int id) {
+    int slot = id & (kMaxCapacity - 1);
+    live_[slot] = false;
+    generations_[slot] = (generations_[slot] + 1) % kGenerations;
+    free_.push_back(slot);
+  }
+
+  int Capacity() const { return static_cast<int>(games_.size()); }
+  int Live() const { return Capacity() - static_cast<int>(free_.size()); }
+  int MaxRows() const { return max_rows_; }
+  int MaxColumns() const { return max_columns_; }
+
+ private:
+  int max_rows_;
+  int max_columns_;
+  std::vector<MineSweeperGame> games_;
+  std::vector<int> generations_;  // The generation of the id of the session in every slot
+  std::vector<char> live_;        // Whether every slot holds an open session
+  std::vector<int> free_;         // The free slots, the most recently freed last
+};
+
+// The session id spelled by word (decimal digits only), or -1.
+inline int ParseSessionId(const std::string &word) {
+  if (word.empty() || word.size() > 10) {
+    return -1;
+  }
+  int64_t id = 0;
+  for (char ch : word) {
+    if (ch < '0' || ch > '9') {
+      return -1;
+    }
+    id = id * 10 + (ch - '0');
+  }
+  return id <= INT32_MAX ? static_cast<int>(id) : -1;
+}
+
+/**
+ * Serve the requests read from in_fd with a table of capacity sessions of at most max_rows * max_columns, writing the
+ * answers to out_fd, until the input ends. Returns false after answering a request that cannot be parsed.
+ */
+inline bool ServeSessions(int in_fd, int out_fd, int capacity, int max_rows, int max_columns) {
+  FastReader in(in_fd);
+  FastWriter out(out_fd);
+  SessionTable table(capacity, max_rows, max_columns);
+  // The map of an open request, packed as InitMap(const uint64_t *) reads it.
+  std::vector<uint64_t> mines((static_cast<size_t>(max_rows) * max_columns + 63) / 64);
+  std::string word;
+  auto error = [&out](const char *message, int id) {
+    out.Write("error ");
+    out.Write(message);
+    if (id >= 0) {
+      out.Write(" ");
+      out.WriteInt(id);
+    }
+    out.Write("\n");
+  };
+  while (true) {
+    // Only wait for more requests once every answer so far is written.
+    in.SkipBufferedSpaces();
+    if (in.Buffered() == 0 && !out.Flush()) {
+      return false;
+    }
+    if (!in.ReadWord(word)) {
+      return true;
+    }
+    if (word == "open") {
+      int rows, columns;
+      if (!in.ReadInt(rows) || !in.ReadInt(columns) || rows < 0 || columns < 0) {
+        error("Bad open", -1);
+        return false;
+      }
+      // The map is read even if it is refused, to stay at the start of the next request.
+      bool fits = rows >= 1 && columns >= 1 && rows <= table.MaxRows() && columns <= table.MaxColumns();
+      size_t blocks = static_cast<size_t>(rows) * columns;
+      if (fits) {
+        std::fill(mines.begin(), mines.end(), 0);
+      }
+      for (size_t block = 0; block < blocks; ++block) {
+        char ch;
+        if (!in.ReadChar(ch)) {
+          error("Bad open", -1);
+          return false;
+        }
+        if (fits && ch == 'X') {
+          mines[block >> 6] |= 1ULL << (block & 63);
+        }
+      }
+      int id = table.Open(rows, columns);
+      if (id < 0) {
+        error(fits ? "No free session" : "Bad map size", -1);
+        continue;
+      }
+      table.Find(id)->InitMap(mines.data());
+      out.WriteInt(id);
+      out.Write(" 0 0\n");
+    } else if (word == "close") {
+      int id;
+      if (!in.ReadInt(id)) {
+        error("Bad close", -1);
+        return false;
+      }
+      if (table.Find(id) == nullptr) {
+        error("No open session", id);
+        continue;
+      }
+      table.Close(id);
+      out.WriteInt(id);
+      out.Write(" closed\n");
+    } else if (word == "stats") {
+      out.Write("sessions ");
+      out.WriteInt(table.Live());
+      out.Write(" ");
+      out.WriteInt(table.Capacity());
+      out.Write("\n");
+    } else {
+      int id = ParseSessionId(word);
+      int row, column, type;
+      if (id < 0 || !in.ReadInt(row) || !in.ReadInt(column) || !in.ReadInt(type)) {
+        error("Bad request", -1);
+        return false;
+      }
+      MineSweeperGame *game = table.Find(id);
+      if (game == nullptr) {
+        error("No open session", id);
+        continue;
+      }
+      if (type < 0 || type > 2) {
+        error("Bad operation type in session", id);
+        continue;
+      }
+      game->Execute(row, column, type);
+      out.WriteInt(id);
+      out.Write(" ");
+      FormatChanges(out.Buffer(), game->getChanges(), game->getGameState());
+      if (game->getGameState() != 0) {
+        // The output of ExitGame(), without the exit.
+        out.WriteInt(game->getVisitCount());
+        out.Write(" ");
+        out.WriteInt(game->getMarkedCount());
+        out.Write("\n");
+        table.Close(id);
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,882 @@
+/**
+ * This header file implements FrontierSolver, the exact mine probability engine of the client.
+ *
+ * The unknown blocks next to a visited block form the frontier. Every visited block with unknown neighbours gives a
+ * constraint: the number of mines among those neighbours is its mine count minus its marked neighbours. The frontier
+ * splits into independent components (blocks linked by shared constraints), and every component is enumerated on its
+ * own by backtracking, counting its consistent assignments by number of mines. The components are then combined with
+ * the unknown blocks away from the frontier (the interior), weighting every total number of frontier mines K by the
+ * C(interior, remaining mines - K) ways to place the rest in the interior. This gives the exact probability that every
+ * unknown block is a mine, assuming every consistent map is equally likely.
+ *
+ * The enumeration visits at most SolverOptions::node_budget search nodes per Solve(), which bounds the latency of a
+ * decision. A component cut short by the budget still contributes the assignments found so far to the probabilities,
+ * but none of its blocks is ever reported as certain. Those partial counts are biased towards the first branches of the
+ * search; with SolverOptions::sample_budget the component is estimated by importance sampling instead (see
+ * SampleComponent()), which converges to the exact probabilities as the number of samples grows. Large components can
+ * be enumerated on several threads with the same results, see EnumerateParallel(). Small components can be looked up
+ * in a PatternCache shared with other solvers, see SolveCached().
+ */
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+#include "pattern_cache.h"
+#include "thread_pool.h"
+
+namespace ClientNS {
+
+struct SolverOptions {
+  bool enabled = true;               // If false, the client guesses uniformly at random like before
+  bool gaussian = true;              // Run GaussianDeducer (gauss.h) before the enumeration
+  long long node_budget = 1 << 20;  // The maximum number of search nodes per Solve()
+  // Components with at least parallel_min_variables blocks are enumerated on threads threads, split at split_depth.
+  int threads = 1;
+  int parallel_min_variables = 32;
+  int split_depth = 12;
+  // Components cut short by the node budget are estimated from up to sample_budget samples per Solve() (0 to keep the
+  // partial counts of the enumeration), for at most sample_seconds per Solve() (0 for no time limit).
+  long long sample_budget = 0;
+  double sample_seconds = 0;
+  // Components of PatternCache::kMinVariables to kMaxVariables blocks are looked up in (and added to) cache, if not
+  // null.
+  PatternCache *cache = nullptr;
+};
+
+/**
+ * The result of enumerating one component: for every number of mines k, the number of consistent assignments with k
+ * mines, and for every block of the component, how many of them put a mine on it.
+ */
+struct ComponentCounts {
+  std::vector<uint64_t> count;                    // count[k]
+  std::vector<std::vector<uint64_t>> mine_count;  // mine_count[k][v]
+  bool exact = true;                              // false if the enumeration was cut short by the budget
+  bool dropped = false;                           // true if no assignment was found before the budget ran out
+  // Set by SampleComponent(): the estimates of count and mine_count from the samples are used instead of them.
+  bool sampled = false;
+  std::vector<double> estimate;                    // estimate[k]
+  std::vector<std::vector<double>> mine_estimate;  // mine_estimate[k][v]
+  long long samples = 0;
+};
+
+class FrontierSolver {
+ public:
+  explicit FrontierSolver(const SolverOptions &options = SolverOptions()) : options_(options) {}
+
+  void SetOptions(const SolverOptions &options) { options_ = options; }
+  const SolverOptions &Options() const { return options_; }
+
+  // Seed the generator of SampleComponent(), so that sampled probabilities are reproducible.
+  void Seed(uint64_t seed) { sample_rng_.seed(seed); }
+
+  /**
+   * Compute the mine probability of every unknown block of map (-1 unknown, -2 marked, 0-8 visited) given the total
+   * number of mines of the game.
+   */
+  void Solve(const Grid<signed char> &map, int total_mines) {
+    CollectConstraints(map);
+    int marked = 0;
+    unknown_.clear();
+    for (size_t i = 0; i < map.Size(); ++i) {
+      if (map.At(i) == -1) {
+        unknown_.push_back(static_cast<int>(i));
+      } else if (map.At(i) == -2) {
+        ++marked;
+      }
+    }
+    nodes_ = 0;
+    samples_ = 0;
+    counts_.assign(components_.size(), ComponentCounts());
+    int interior = static_cast<int>(unknown_.size() - variables_.size());
+    for (size_t i = 0; i < components_.size(); ++i) {
+      // Share what is left of the budget among the components left, so that a huge component cannot starve the others.
+      node_limit_ = nodes_ + (options_.node_budget - nodes_) / static_cast<long long>(components_.size() - i);
+      int n = static_cast<int>(components_[i].variables.size());
+      if (options_.cache != nullptr && n >= PatternCache::kMinVariables && n <= PatternCache::kMaxVariables) {
+        SolveCached(components_[i], counts_[i]);
+      } else {
+        Enumerate(components_[i], counts_[i]);
+      }
+    }
+    if (options_.sample_budget > 0) {
+      SampleInexact();
+    }
+    for (size_t i = 0; i < components_.size(); ++i) {
+      if (!counts_[i].exact && !counts_[i].sampled &&
+          *std::max_element(counts_[i].count.begin(), counts_[i].count.end()) == 0) {
+        // Not a single assignment found: treat its blocks like the interior.
+        counts_[i].dropped = true;
+        interior += static_cast<int>(components_[i].variables.size());
+      }
+    }
+    Combine(total_mines - marked, interior);
+  }
+
+  // The unknown blocks (row-major indices) that are certainly not mines / certainly mines, in increasing order.
+  const std::vector<int> &SafeBlocks() const { return safe_; }
+  const std::vector<int> &MineBlocks() const { return mines_; }
+
+  // The probability that block (row-major index) is a mine, or -1 if it is not unknown.
+  double Probability(int block) const { return probability_[block]; }
+
+  // True if no component was cut short by the budget in the last Solve().
+  bool Exact() const { return exact_; }
+
+  long long Nodes() const { return nodes_; }
+
+  // The samples drawn by SampleComponent() in the last Solve().
+  long long Samples() const { return samples_; }
+
+  /**
+   * The unknown block with the lowest probability of being a mine. Ties are broken at random with rng.
+   */
+  template <class Rng>
+  int BestGuess(Rng &rng) const {
+    const double kTolerance = 1e-12;
+    double best = 2;
+    std::vector<int> candidates;
+    for (int block : unknown_) {
+      double p = probability_[block];
+      if (p < best - kTolerance) {
+        best = p;
+        candidates.clear();
+      }
+      if (p <= best + kTolerance) {
+        candidates.push_back(block);
+      }
+    }
+    if (candidates.empty()) {
+      return -1;
+    }
+    return candidates[rng() % candidates.size()];
+  }
+
+ protected:
+  static const long long kFlushNodes = 1 << 12;  // How often a parallel search publishes its node count
+
+  struct Constraint {
+    int block;                   // The visited block (row-major index)
+    int mines;                   // The number of mines among variables
+    std::vector<int> variables;  // Indices into variables_
+  };
+
+  struct Component {
+    std::vector<int> variables;    // Indices into variables_, in search order
+    std::vector<int> constraints;  // Indices into constraints_
+  };
+
+  /**
+   * Build the constraints of the visited blocks, the frontier variables and the components.
+   */
+  void CollectConstraints(const Grid<signed char> &map) {
+    int rows = map.Rows();
+    int columns = map.Columns();
+    columns_ = columns;
+    constraints_.clear();
+    variables_.clear();
+    variable_of_.assign(map.Size(), -1);
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < columns; ++j) {
+        if (map[i][j] < 0) {
+          continue;
+        }
+        Constraint constraint;
+        constraint.block = i * columns + j;
+        constraint.mines = map[i][j];
+        for (int x = i - 1; x <= i + 1; ++x) {
+          for (int y = j - 1; y <= j + 1; ++y) {
+            if (x < 0 || x >= rows || y < 0 || y >= columns) {
+              continue;
+            }
+            if (map[x][y] == -2) {
+              --constraint.mines;
+            } else if (map[x][y] == -1) {
+              int block = x * columns + y;
+              if (variable_of_[block] < 0) {
+                variable_of_[block] = static_cast<int>(variables_.size());
+                variables_.push_back(block);
+              }
+              constraint.variables.push_back(variable_of_[block]);
+            }
+          }
+        }
+        if (!constraint.variables.empty()) {
+          constraints_.push_back(constraint);
+        }
+      }
+    }
+    // Group the variables linked by constraints, in breadth-first order so that constraints are closed early.
+    std::vector<std::vector<int>> constraints_of(variables_.size());
+    for (size_t c = 0; c < constraints_.size(); ++c) {
+      for (int v : constraints_[c].variables) {
+        constraints_of[v].push_back(static_cast<int>(c));
+      }
+    }
+    components_.clear();
+    std::vector<char> seen_variable(variables_.size(), 0);
+    std::vector<char> seen_constraint(constraints_.size(), 0);
+    for (size_t start = 0; start < variables_.size(); ++start) {
+      if (seen_variable[start]) {
+        continue;
+      }
+      Component component;
+      seen_variable[start] = 1;
+      component.variables.push_back(static_cast<int>(start));
+      for (size_t head = 0; head < component.variables.size(); ++head) {
+        for (int c : constraints_of[component.variables[head]]) {
+          if (seen_constraint[c]) {
+            continue;
+          }
+          seen_constraint[c] = 1;
+          component.constraints.push_back(c);
+          for (int v : constraints_[c].variables) {
+            if (!seen_variable[v]) {
+              seen_variable[v] = 1;
+              component.variables.push_back(v);
+            }
+          }
+        }
+      }
+      components_.push_back(component);
+    }
+  }
+
+  /**
+   * Count the consistent assignments of a component by backtracking over its variables in search order. A branch is
+   * cut as soon as a constraint has too many mines, or too few unassigned variables left to reach its count.
+   */
+  void Enumerate(const Component &component, ComponentCounts &counts) {
+    int n = static_cast<int>(component.variables.size());
+    counts.count.assign(n + 1, 0);
+    counts.mine_count.assign(n + 1, std::vector<uint64_t>(n, 0));
+    counts.exact = true;
+    SearchState root = Prepare(component);
+    root.limit = node_limit_ - nodes_;
+    if (options_.threads > 1 && n >= options_.parallel_min_variables && n > options_.split_depth &&
+        EnumerateParallel(root, counts)) {
+      return;
+    }
+    root.counts = &counts;
+    Search(root, 0, 0);
+    nodes_ += root.nodes;
+  }
+
+  /**
+   * Count the assignments of a small component from options_.cache, or enumerate it completely and add it to the cache.
+   * Neither is charged to the node budget, so that what the other components get does not depend on the state of the
+   * cache (which other games may be changing): the results are the same as without the cache whenever the budget does
+   * not bind, and do not depend on the timing of the threads sharing the cache in any case.
+   */
+  void SolveCached(const Component &component, ComponentCounts &counts) {
+    int n = static_cast<int>(component.variables.size());
+    PatternKey key;
+    std::vector<int> &canonical = pattern_scratch_.canonical;
+    PatternOf(component, key, canonical);
+    counts.exact = true;
+    if (options_.cache->Find(key, pattern_count_, pattern_mine_count_)) {
+      counts.count = pattern_count_;
+      counts.mine_count.assign(n + 1, std::vector<uint64_t>(n, 0));
+      for (int k = 0; k <= n; ++k) {
+        for (int p = 0; p < n; ++p) {
+          counts.mine_count[k][p] = pattern_mine_count_[k][canonical[p]];
+        }
+      }
+      return;
+    }
+    counts.count.assign(n + 1, 0);
+    counts.mine_count.assign(n + 1, std::vector<uint64_t>(n, 0));
+    SearchState root = Prepare(component);
+    root.limit = std::numeric_limits<long long>::max();
+    root.counts = &counts;
+    Search(root, 0, 0);
+    pattern_mine_count_.assign(n + 1, std::vector<uint64_t>(n, 0));
+    for (int k = 0; k <= n; ++k) {
+      for (int p = 0; p < n; ++p) {
+        pattern_mine_count_[k][canonical[p]] = counts.mine_count[k][p];
+      }
+    }
+    options_.cache->Insert(key, counts.count, pattern_mine_count_);
+  }
+
+  /**
+   * The cache key of a component: its variables (tagged 0xFF) and its constraints (tagged with the mines they need) as
+   * items row << 32 | column << 8 | tag, in the least of the 8 rotations and reflections of the component (moved to
+   * the origin) in the order of their sorted items. canonical[p] is the rank of the variable at search position p among
+   * the variables of that order.
+   */
+  void PatternOf(const Component &component, PatternKey &key, std::vector<int> &canonical) {
+    const uint64_t kVariableTag = 0xFF;
+    int n = static_cast<int>(component.variables.size());
+    // The blocks of the component (variables first) relative to their bounding box, and their tags.
+    PatternScratch &scratch = pattern_scratch_;
+    scratch.rows.clear();
+    scratch.columns.clear();
+    scratch.tags.clear();
+    auto add = [&](int block, uint64_t tag) {
+      scratch.rows.push_back(block / columns_);
+      scratch.columns.push_back(block % columns_);
+      scratch.tags.push_back(tag);
+    };
+    for (int v : component.variables) {
+      add(variables_[v], kVariableTag);
+    }
+    for (int c : component.constraints) {
+      add(constraints_[c].block, static_cast<uint64_t>(constraints_[c].mines));
+    }
+    size_t size = scratch.tags.size();
+    int min_row = *std::min_element(scratch.rows.begin(), scratch.rows.end());
+    int max_row = *std::max_element(scratch.rows.begin(), scratch.rows.end());
+    int min_column = *std::min_element(scratch.columns.begin(), scratch.columns.end());
+    int max_column = *std::max_element(scratch.columns.begin(), scratch.columns.end());
+    scratch.items.resize(size);
+    std::vector<std::pair<uint64_t, int>> &variables = scratch.variables;  // (item, search position), best transform
+    variables.resize(n);
+    for (int transform = 0; transform < 8; ++transform) {
+      for (size_t i = 0; i < size; ++i) {
+        uint64_t r = transform & 1 ? max_row - scratch.rows[i] : scratch.rows[i] - min_row;
+        uint64_t c = transform & 2 ? max_column - scratch.columns[i] : scratch.columns[i] - min_column;
+        if (transform & 4) {
+          std::swap(r, c);
+        }
+        scratch.items[i] = r << 32 | c << 8 | scratch.tags[i];
+      }
+      scratch.sorted = scratch.items;
+      std::sort(scratch.sorted.begin(), scratch.sorted.end());
+      if (transform == 0 || scratch.sorted < scratch.best) {
+        scratch.best.swap(scratch.sorted);
+        for (int p = 0; p < n; ++p) {
+          variables[p] = {scratch.items[p], p};
+        }
+      }
+    }
+    std::sort(variables.begin(), variables.end());
+    canonical.assign(n, 0);
+    for (int i = 0; i < n; ++i) {
+      canonical[variables[i].second] = i;
+    }
+    key.variables = n;
+    for (int half = 0; half < 2; ++half) {
+      uint64_t hash = half == 0 ? 0x9E3779B97F4A7C15ULL : 0xC2B2AE3D27D4EB4FULL;
+      for (uint64_t item : scratch.best) {
+        hash = Mix(hash ^ item);
+      }
+      key.hash[half] = Mix(hash ^ size);
+    }
+  }
+
+  // The finalizer of SplitMix64.
+  static uint64_t Mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  }
+
+  /**
+   * Estimate the components the enumeration cut short by SampleComponent(), sharing the sample budget and the time
+   * budget among them like Solve() shares the node budget.
+   */
+  void SampleInexact() {
+    using Clock = std::chrono::steady_clock;
+    std::vector<size_t> inexact;
+    for (size_t i = 0; i < components_.size(); ++i) {
+      if (!counts_[i].exact) {
+        inexact.push_back(i);
+      }
+    }
+    Clock::time_point start = Clock::now();
+    for (size_t j = 0; j < inexact.size(); ++j) {
+      long long left = static_cast<long long>(inexact.size() - j);
+      long long samples = (options_.sample_budget - samples_) / left;
+      Clock::time_point deadline = Clock::time_point::max();
+      if (options_.sample_seconds > 0) {
+        std::chrono::duration<double> remaining =
+            start + std::chrono::duration<double>(options_.sample_seconds) - Clock::now();
+        deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(remaining / static_cast<double>(left));
+      }
+      SampleComponent(components_[inexact[j]], counts_[inexact[j]], samples, deadline);
+      samples_ += counts_[inexact[j]].samples;
+    }
+  }
+
+  /**
+   * Estimate the counts of a component by sequential importance sampling of its search tree (Knuth's estimator): a
+   * sample assigns the variables in search order, each to a value drawn uniformly from the values that the checks of
+   * Search() allow, and weighs a complete assignment by the product of the number of allowed values along the way. The
+   * average weight of the assignments with k mines is an unbiased estimate of count[k], and likewise for
+   * mine_count[k][v], so the probabilities Combine() computes from them converge to the exact ones. Draws up to
+   * samples samples, and stops earlier at deadline (checked every few samples).
+   */
+  void SampleComponent(const Component &component, ComponentCounts &counts, long long samples,
+                       std::chrono::steady_clock::time_point deadline) {
+    const long long kClockSamples = 64;
+    int n = static_cast<int>(component.variables.size());
+    SearchState state = Prepare(component);
+    counts.estimate.assign(n + 1, 0);
+    counts.mine_estimate.assign(n + 1, std::vector<double>(n, 0));
+    counts.samples = 0;
+    int allowed[2];
+    while (counts.samples < samples &&
+           (counts.samples % kClockSamples != 0 || std::chrono::steady_clock::now() < deadline)) {
+      ++counts.samples;
+      double weight = 1;
+      int mines = 0;
+      int position = 0;
+      for (; position < n; ++position) {
+        int choices = 0;
+        for (int value = 0; value <= 1; ++value) {
+          bool ok = true;
+          for (int c : constraints_at_[position]) {
+            int need = state.need[c] - value;
+            if (need < 0 || need > state.left[c] - 1) {
+              ok = false;
+              break;
+            }
+          }
+          if (ok) {
+            allowed[choices++] = value;
+          }
+        }
+        if (choices == 0) {
+          break;
+        }
+        int value = allowed[choices == 1 ? 0 : sample_rng_() & 1];
+        weight *= choices;
+        for (int c : constraints_at_[position]) {
+          state.need[c] -= value;
+          --state.left[c];
+        }
+        state.assignment[position] = static_cast<char>(value);
+        mines += value;
+      }
+      if (position == n) {
+        counts.estimate[mines] += weight;
+        std::vector<double> &mine_estimate = counts.mine_estimate[mines];
+        for (int p = 0; p < n; ++p) {
+          if (state.assignment[p]) {
+            mine_estimate[p] += weight;
+          }
+        }
+      }
+      // Undo the sample.
+      while (position-- > 0) {
+        for (int c : constraints_at_[position]) {
+          state.need[c] += state.assignment[position];
+          ++state.left[c];
+        }
+      }
+    }
+    for (int k = 0; k <= n; ++k) {
+      counts.estimate[k] /= std::max(counts.samples, 1LL);
+      for (double &estimate : counts.mine_estimate[k]) {
+        estimate /= std::max(counts.samples, 1LL);
+      }
+    }
+    counts.sampled = *std::max_element(counts.estimate.begin(), counts.estimate.end()) > 0;
+  }
+
+  /**
+   * The state of one backtracking search: the constraints of the component left to satisfy and the assignment so far.
+   */
+  struct SearchState {
+    std::vector<int> need;  // Mines still needed by every constraint
+    std::vector<int> left;  // Unassigned variables of every constraint
+    std::vector<char> assignment;
+    int mines = 0;                      // Mines in the assignment so far
+    ComponentCounts *counts = nullptr;  // Where solutions are counted
+    long long nodes = 0;
+    long long limit = 0;  // The search gives up once nodes exceeds it
+    // Parallel search only: stop at this depth and save the state as a subtree to search later.
+    int split = -1;
+    std::vector<SearchState> *subtrees = nullptr;
+    // Parallel search only: the nodes of all the subtrees, to give up as soon as their sum exceeds the limit.
+    std::atomic<long long> *shared_nodes = nullptr;
+    long long flushed = 0;
+  };
+
+  /**
+   * The root of the search of a component: its constraints with all their variables unassigned. Also fills
+   * constraints_at_ for the component.
+   */
+  SearchState Prepare(const Component &component) {
+    int n = static_cast<int>(component.variables.size());
+    std::vector<int> position_of(variables_.size(), -1);
+    for (int p = 0; p < n; ++p) {
+      position_of[component.variables[p]] = p;
+    }
+    SearchState root;
+    root.need.assign(component.constraints.size(), 0);
+    root.left.assign(component.constraints.size(), 0);
+    constraints_at_.assign(n, std::vector<int>());
+    for (size_t c = 0; c < component.constraints.size(); ++c) {
+      const Constraint &constraint = constraints_[component.constraints[c]];
+      root.need[c] = constraint.mines;
+      root.left[c] = static_cast<int>(constraint.variables.size());
+      for (int v : constraint.variables) {
+        constraints_at_[position_of[v]].push_back(static_cast<int>(c));
+      }
+    }
+    root.assignment.assign(n, 0);
+    return root;
+  }
+
+  void Search(SearchState &state, int position, int mines) {
+    ComponentCounts &counts = *state.counts;
+    if (++state.nodes > state.limit) {
+      counts.exact = false;
+      return;
+    }
+    if (state.shared_nodes != nullptr && state.nodes - state.flushed >= kFlushNodes) {
+      long long total = state.shared_nodes->fetch_add(state.nodes - state.flushed) + (state.nodes - state.flushed);
+      state.flushed = state.nodes;
+      if (total > state.limit) {
+        counts.exact = false;
+        return;
+      }
+    }
+    if (position == state.split) {
+      // The root of the subtree is counted when the subtree is searched.
+      --state.nodes;
+      state.subtrees->push_back(state);
+      state.subtrees->back().mines = mines;
+      state.subtrees->back().nodes = 0;
+      return;
+    }
+    int n = static_cast<int>(state.assignment.size());
+    if (position == n) {
+      ++counts.count[mines];
+      std::vector<uint64_t> &mine_count = counts.mine_count[mines];
+      for (int p = 0; p < n; ++p) {
+        mine_count[p] += state.assignment[p];
+      }
+      return;
+    }
+    const std::vector<int> &constraints = constraints_at_[position];
+    for (int value = 0; value <= 1; ++value) {
+      bool ok = true;
+      for (int c : constraints) {
+        int need = state.need[c] - value;
+        if (need < 0 || need > state.left[c] - 1) {
+          ok = false;
+          break;
+        }
+      }
+      if (!ok) {
+        continue;
+      }
+      for (int c : constraints) {
+        state.need[c] -= value;
+        --state.left[c];
+      }
+      state.assignment[position] = static_cast<char>(value);
+      Search(state, position + 1, mines + value);
+      for (int c : constraints) {
+        state.need[c] += value;
+        ++state.left[c];
+      }
+      if (!counts.exact) {
+        return;
+      }
+    }
+  }
+
+  /**
+   * Enumerate a component on the thread pool: the search tree is cut at depth split_depth, and every subtree left is
+   * a task. A task counts into its own accumulators and adds them to the totals when it is done. The search visits
+   * exactly the nodes of the sequential search, so it finishes within the limit exactly when the sequential search
+   * does, and then gives the same counts (integer sums do not depend on the order). Returns false if the limit was
+   * exceeded; the caller then runs the sequential search, whose partial counts depend on the order of the search.
+   */
+  bool EnumerateParallel(const SearchState &root, ComponentCounts &counts) {
+    std::vector<SearchState> subtrees;
+    ComponentCounts prefix_counts = counts;
+    SearchState prefix = root;
+    prefix.counts = &prefix_counts;
+    prefix.split = options_.split_depth;
+    prefix.subtrees = &subtrees;
+    Search(prefix, 0, 0);
+    if (!prefix_counts.exact) {
+      return false;
+    }
+    std::atomic<long long> shared_nodes(prefix.nodes);
+    std::mutex mutex;  // Guards counts
+    ThreadPool &pool = SharedPool(options_.threads);
+    TaskGroup group;
+    for (size_t t = 0; t < subtrees.size(); ++t) {
+      pool.Submit([this, &subtrees, &counts, &shared_nodes, &mutex, t] {
+        SearchState &state = subtrees[t];
+        ComponentCounts local;
+        local.count.assign(counts.count.size(), 0);
+        local.mine_count.assign(counts.count.size(), std::vector<uint64_t>(state.assignment.size(), 0));
+        state.split = -1;
+        state.subtrees = nullptr;
+        state.counts = &local;
+        state.shared_nodes = &shared_nodes;
+        Search(state, options_.split_depth, state.mines);
+        shared_nodes.fetch_add(state.nodes - state.flushed);
+        state.flushed = state.nodes;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!local.exact) {
+          counts.exact = false;
+          return;
+        }
+        for (size_t k = 0; k < counts.count.size(); ++k) {
+          counts.count[k] += local.count[k];
+          for (size_t p = 0; p < counts.mine_count[k].size(); ++p) {
+            counts.mine_count[k][p] += local.mine_count[k][p];
+          }
+        }
+      }, &group);
+    }
+    pool.Wait(group);
+    long long total = prefix.nodes;
+    for (const SearchState &state : subtrees) {
+      total += state.nodes;
+    }
+    if (!counts.exact || total > root.limit) {
+      for (size_t k = 0; k < counts.count.size(); ++k) {
+        counts.count[k] = 0;
+        counts.mine_count[k].assign(counts.mine_count[k].size(), 0);
+      }
+      counts.exact = true;
+      return false;
+    }
+    nodes_ += total;
+    return true;
+  }
+
+  /**
+   * The process-wide pool used by parallel enumerations with the given number of threads.
+   */
+  static ThreadPool &SharedPool(int threads) {
+    static std::mutex mutex;
+    static std::map<int, std::unique_ptr<ThreadPool>> pools;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<ThreadPool> &pool = pools[threads];
+    if (!pool) {
+      pool.reset(new ThreadPool(threads));
+    }
+    return *pool;
+  }
+
+  static double LogBinomial(int n, int k) {
+    return std::lgamma(n + 1.0) - std::lgamma(k + 1.0) - std::lgamma(n - k + 1.0);
+  }
+
+  template <class T>
+  static std::vector<T> Convolve(const std::vector<T> &a, const std::vector<T> &b) {
+    std::vector<T> result(a.size() + b.size() - 1, T());
+    for (size_t i = 0; i < a.size(); ++i) {
+      if (a[i] == T()) {
+        continue;
+      }
+      for (size_t j = 0; j < b.size(); ++j) {
+        result[i + j] += a[i] * b[j];
+      }
+    }
+    return result;
+  }
+
+  static std::vector<char> ConvolveFeasible(const std::vector<char> &a, const std::vector<char> &b) {
+    std::vector<char> result(a.size() + b.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+      for (size_t j = 0; a[i] && j < b.size(); ++j) {
+        result[i + j] |= b[j];
+      }
+    }
+    return result;
+  }
+
+  // The number of assignments of a component with k mines, or its estimate if the component was sampled.
+  static double Count(const ComponentCounts &counts, size_t k) {
+    return counts.sampled ? counts.estimate[k] : static_cast<double>(counts.count[k]);
+  }
+
+  /**
+   * Combine the component counts with the interior. remaining is the number of mines not marked yet, interior the
+   * number of unknown blocks outside the frontier.
+   */
+  void Combine(int remaining, int interior) {
+    size_t c = counts_.size();
+    exact_ = true;
+    // Scale every component's counts to at most 1: probabilities do not change and products cannot overflow.
+    std::vector<std::vector<double>> weight(c);
+    std::vector<std::vector<char>> feasible(c);
+    std::vector<double> scale(c, 1);
+    for (size_t i = 0; i < c; ++i) {
+      exact_ = exact_ && counts_[i].exact;
+      double largest = 0;
+      for (size_t k = 0; k < counts_[i].count.size(); ++k) {
+        largest = std::max(largest, Count(counts_[i], k));
+      }
+      scale[i] = largest > 0 ? 1.0 / largest : 1;
+      if (counts_[i].dropped) {
+        weight[i].assign(1, 1.0);
+        feasible[i].assign(1, 1);
+        continue;
+      }
+      for (size_t k = 0; k < counts_[i].count.size(); ++k) {
+        weight[i].push_back(Count(counts_[i], k) * scale[i]);
+        feasible[i].push_back(Count(counts_[i], k) > 0);
+      }
+    }
+    // prefix[i] / suffix[i]: the distribution of the number of mines in the components before i / from i on.
+    std::vector<std::vector<double>> prefix(c + 1, std::vector<double>(1, 1.0));
+    std::vector<std::vector<double>> suffix(c + 1, std::vector<double>(1, 1.0));
+    std::vector<std::vector<char>> prefix_feasible(c + 1, std::vector<char>(1, 1));
+    std::vector<std::vector<char>> suffix_feasible(c + 1, std::vector<char>(1, 1));
+    for (size_t i = 0; i < c; ++i) {
+      prefix[i + 1] = Convolve(prefix[i], weight[i]);
+      prefix_feasible[i + 1] = ConvolveFeasible(prefix_feasible[i], feasible[i]);
+    }
+    for (size_t i = c; i-- > 0;) {
+      suffix[i] = Convolve(weight[i], suffix[i + 1]);
+      suffix_feasible[i] = ConvolveFeasible(feasible[i], suffix_feasible[i + 1]);
+    }
+    // interior_weight[K]: C(interior, remaining - K), relative to its largest value, if K frontier mines is possible.
+    const std::vector<double> &total = prefix[c];
+    std::vector<double> interior_weight(total.size(), 0);
+    std::vector<char> interior_ok(total.size(), 0);
+    double largest_log = -HUGE_VAL;
+    for (size_t k = 0; k < total.size(); ++k) {
+      int rest = remaining - static_cast<int>(k);
+      if (rest >= 0 && rest <= interior) {
+        interior_ok[k] = 1;
+        largest_log = std::max(largest_log, LogBinomial(interior, rest));
+      }
+    }
+    double z = 0;
+    double interior_mines = 0;
+    bool interior_always_empty = true;
+    bool interior_always_full = true;
+    for (size_t k = 0; k < total.size(); ++k) {
+      if (!interior_ok[k]) {
+        continue;
+      }
+      int rest = remaining - static_cast<int>(k);
+      interior_weight[k] = std::exp(LogBinomial(interior, rest) - largest_log);
+      z += total[k] * interior_weight[k];
+      interior_mines += total[k] * interior_weight[k] * rest;
+      if (prefix_feasible[c][k]) {
+        interior_always_empty = interior_always_empty && rest == 0;
+        interior_always_full = interior_always_full && rest == interior;
+      }
+    }
+
+    probability_.assign(variable_of_.size(), -1);
+    safe_.clear();
+    mines_.clear();
+    bool consistent = z > 0;
+    double interior_probability = interior > 0 && consistent ? interior_mines / z / interior : 0;
+    if (!consistent) {
+      // Should not happen on a real game; fall back to the plain density of the remaining mines.
+      interior_probability = unknown_.empty() ? 0 : static_cast<double>(remaining) / unknown_.size();
+    }
+    for (int block : unknown_) {
+      probability_[block] = interior_probability;
+    }
+    if (consistent && exact_) {
+      if (interior_always_empty || interior_always_full) {
+        for (int block : unknown_) {
+          if (variable_of_[block] < 0) {
+            (interior_always_empty ? safe_ : mines_).push_back(block);
+          }
+        }
+      }
+    }
+
+    for (size_t i = 0; i < c && consistent; ++i) {
+      const ComponentCounts &counts = counts_[i];
+      if (counts.dropped) {
+        continue;
+      }
+      const Component &component = components_[i];
+      std::vector<double> others = Convolve(prefix[i], suffix[i + 1]);
+      std::vector<char> others_feasible = ConvolveFeasible(prefix_feasible[i], suffix_feasible[i + 1]);
+      // The weight of k mines in this component, summed over the other components and the interior.
+      size_t n = component.variables.size();
+      std::vector<double> context(n + 1, 0);
+      std::vector<char> reachable(n + 1, 0);
+      for (size_t k = 0; k <= n; ++k) {
+        for (size_t j = 0; j < others.size() && k + j < total.size(); ++j) {
+          context[k] += others[j] * interior_weight[k + j];
+          reachable[k] |= others_feasible[j] && interior_ok[k + j];
+        }
+        reachable[k] = reachable[k] && Count(counts, k) > 0;
+      }
+      for (size_t p = 0; p < n; ++p) {
+        double mines = 0;
+        bool never = true;
+        bool always = true;
+        for (size_t k = 0; k <= n; ++k) {
+          mines += (counts.sampled ? counts.mine_estimate[k][p] : counts.mine_count[k][p]) * scale[i] * context[k];
+          if (reachable[k]) {
+            never = never && counts.mine_count[k][p] == 0;
+            always = always && counts.mine_count[k][p] == counts.count[k];
+          }
+        }
+        int block = variables_[component.variables[p]];
+        probability_[block] = mines / z;
+        if (counts.exact) {
+          if (never) {
+            safe_.push_back(block);
+            probability_[block] = 0;
+          } else if (always) {
+            mines_.push_back(block);
+            probability_[block] = 1;
+          }
+        }
+      }
+    }
+    std::sort(safe_.begin(), safe_.end());
+    std::sort(mines_.begin(), mines_.end());
+  }
+
+  SolverOptions options_;
+  int columns_ = 0;
+  std::vector<Constraint> constraints_;
+  std::vector<int> variables_;    // The frontier blocks (row-major indices)
+  std::vector<int> variable_of_;  // The variable of every block, or -1
+  std::vector<Component> components_;
+  std::vector<ComponentCounts> counts_;
+  std::vector<int> unknown_;
+  std::vector<double> probability_;
+  std::vector<int> safe_;
+  std::vector<int> mines_;
+  std::vector<std::vector<int>> constraints_at_;  // The constraints of the variable at every search position
+  long long nodes_ = 0;
+  long long node_limit_ = 0;  // Search() gives up on the current component once nodes_ exceeds it
+  long long samples_ = 0;
+  std::mt19937_64 sample_rng_;
+  // The working memory of SolveCached() and PatternOf(), kept between components.
+  struct PatternScratch {
+    std::vector<int> rows;
+    std::vector<int> columns;
+    std::vector<uint64_t> tags;
+    std::vector<uint64_t> items;
+    std::vector<uint64_t> sorted;
+    std::vector<uint64_t> best;
+    std::vector<std::pair<uint64_t, int>> variables;
+    std::vector<int> canonical;  // The canonical index of the variable at every search position
+  };
+  PatternScratch pattern_scratch_;
+  std::vector<uint64_t> pattern_count_;  // The counts of SolveCached() in canonical order
+  std::vector<std::vector<uint64_t>> pattern_mine_count_;
+  bool exact_ = true;
+};
+
+}  // namespace ClientNS
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * A small work-stealing thread pool used to spread independent tasks (games of a batch, subtrees of a search) over
+ * several cores.
+ *
+ * Every worker owns a deque of tasks. A worker takes tasks from the back of its own deque and, when it runs dry, steals
+ * from the front of the others, so tasks submitted in order are mostly executed in order and large tasks pushed first
+ * are the ones stolen. Tasks submitted from a worker go to that worker's deque.
+ *
+ * Tasks can be submitted as part of a TaskGroup, so that one caller can wait for its own tasks while other callers
+ * share the pool.
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A set of tasks that can be waited for on its own, see ThreadPool::Submit() and ThreadPool::Wait().
+ */
+struct TaskGroup {
+  std::atomic<size_t> pending{0};
+};
+
+class ThreadPool {
+ public:
+  typedef std::function<void()> Task;
+
+  /**
+   * Start a pool with the given number of workers. 0 means one worker per hardware thread.
+   */
+  explicit ThreadPool(int threads = 0) {
+    if (threads <= 0) {
+      threads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    if (threads <= 0) {
+      threads = 1;
+    }
+    for (int i = 0; i < threads; ++i) {
+      queues_.emplace_back(new Queue());
+    }
+    for (int i = 0; i < threads; ++i) {
+      workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int Size() const { return static_cast<int>(workers_.size()); }
+
+  /**
+   * Schedule a task, optionally as part of group. Tasks submitted from outside the pool are dealt round-robin to the
+   * workers.
+   */
+  void Submit(Task task, TaskGroup *group = nullptr) {
+    size_t target = CurrentWorker();
+    if (target == kNotAWorker) {
+      target = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    }
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    if (group != nullptr) {
+      group->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+      std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+      queues_[target]->tasks.push_back({std::move(task), group});
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++queued_;
+    }
+    wake_.notify_all();
+  }
+
+  /**
+   * Wait until every submitted task has finished. The waiting thread executes tasks itself in the meantime, so it is
+   * safe to wait from inside a task.
+   */
+  void Wait() { WaitFor(pending_); }
+
+  /**
+   * Wait until every task of group has finished, executing tasks (of any group) in the meantime.
+   */
+  void Wait(TaskGroup &group) { WaitFor(group.pending); }
+
+ private:
+  static constexpr size_t kNotAWorker = static_cast<size_t>(-1);
+
+  struct Entry {
+    Task task;
+    TaskGroup *group;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Entry> tasks;
+  };
+
+  void WaitFor(const std::atomic<size_t> &counter) {
+    size_t self = CurrentWorker();
+    while (counter.load(std::memory_order_acquire) != 0) {
+      Entry entry;
+      if (TakeTask(self == kNotAWorker ? 0 : self, entry)) {
+        RunTask(entry);
+      } else {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this, &counter] { return counter.load(std::memory_order_acquire) == 0 || queued_ > 0; });
+      }
+    }
+  }
+
+  size_t CurrentWorker() const {
+    return current_pool_ == this ? current_index_ : kNotAWorker;
+  }
+
+  // Pop from the back of our own deque, or steal from the front of another one.
+  bool TakeTask(size_t self, Entry &task) {
+    size_t n = queues_.size();
+    bool found = false;
+    for (size_t k = 0; k < n && !found; ++k) {
+      Queue &queue = *queues_[(self + k) % n];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (k == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+      found = true;
+    }
+    if (found) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --queued_;
+    }
+    return found;
+  }
+
+  void RunTask(Entry &entry) {
+    entry.task();
+    bool group_done = entry.group != nullptr && entry.group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1 || group_done) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wake_.notify_all();
+    }
+  }
+
+  void WorkerLoop(size_t index) {
+    current_pool_ = this;
+    current_index_ = index;
+    while (true) {
+      Entry task;
+      if (TakeTask(index, task)) {
+        RunTask(task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+      if (stopping_ && queued_ <= 0) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_queue_{0};
+  std::atomic<size_t> pending_{0};
+  std::mutex mutex_;
+  std::condition_variable wake_;  // Signalled when a task is queued, the pool stops or a pending count drops to 0
+  long queued_ = 0;  // Tasks sitting in the deques, guarded by mutex_ (briefly -1 while a Submit() is in flight)
+  bool stopping_ = false;
+
+  static thread_local const ThreadPool *current_pool_;
+  static thread_local size_t current_index_;
+};
+
+inline thread_local const ThreadPool *ThreadPool::current_pool_ = nullptr;
+inline thread_local size_t ThreadPool::current_index_ = 0;
+
+#endif
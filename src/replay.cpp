@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "bitboard.h"
+#include "corpus.h"
+#include "replay.h"
+#include "server.h"
+
+bool OpenLog(ReplayReader &log, const std::string &path) {
+  std::string error;
+  if (!log.Open(path, &error)) {
+    std::cerr << "Cannot read the replay log: " << error << std::endl;
+    return false;
+  }
+  if (!log.Indexed()) {
+    std::cerr << path << " has no index (its writer did not finish), found " << log.Size() << " games" << std::endl;
+  }
+  return true;
+}
+
+/**
+ * Replay games first_game to first_game + games - 1 of the log (all the games from first_game if games < 0) and
+ * report the ones whose result differs from the recorded one.
+ */
+template <class Game>
+int Verify(const ReplayReader &log, int first_game, int games) {
+  using Clock = std::chrono::steady_clock;
+  int end = games < 0 ? log.Size() : std::min(log.Size(), first_game + games);
+  long long operations = 0;
+  int mismatches = 0;
+  Clock::time_point start = Clock::now();
+  for (int i = first_game; i < end; ++i) {
+    ReplayGame game = log.Game(i);
+    ReplayCheck check = ReplayOne<Game>(game);
+    operations += check.operations;
+    if (!check.ok) {
+      ++mismatches;
+      const ReplayGameHeader &header = *game.header;
+      std::cerr << "game " << i << " (index " << header.index << "): recorded " << header.game_state << " "
+                << header.visit_count << " " << header.marked_count << " after " << header.operation_count + 1
+                << " operations, replayed " << check.game_state << " " << check.visit_count << " "
+                << check.marked_count << " after " << check.operations << std::endl;
+    }
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << "games " << std::max(end - first_game, 0) << std::endl;
+  std::cout << "mismatches " << mismatches << std::endl;
+  std::cout << "operations " << operations << std::endl;
+  std::cout << "operations_per_second " << (seconds > 0 ? operations / seconds : 0) << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
+
+int Info(const ReplayReader &log) {
+  std::cout << "games " << log.Size() << std::endl;
+  for (int i = 0; i < log.Size(); ++i) {
+    const ReplayGameHeader &header = *log.Game(i).header;
+    std::cout << i << " " << header.rows << " " << header.columns << " " << header.first_row << " "
+              << header.first_column << " " << header.seed << " " << header.index << " " << header.game_state << " "
+              << header.visit_count << " " << header.marked_count << " " << header.operation_count + 1 << " "
+              << header.operation_bytes << std::endl;
+  }
+  return 0;
+}
+
+// Print game i of the log as the input of `server`: the map, then "row column type" for every operation.
+int Show(const ReplayReader &log, int i) {
+  if (i < 0 || i >= log.Size()) {
+    std::cerr << "No game " << i << " in a log of " << log.Size() << " games" << std::endl;
+    return 1;
+  }
+  ReplayGame game = log.Game(i);
+  CorpusBoard board;
+  board.rows = game.header->rows;
+  board.columns = game.header->columns;
+  board.mines = game.mines;
+  std::ios::sync_with_stdio(false);
+  std::cout << board.rows << " " << board.columns << "\n";
+  std::string line;
+  for (int r = 0; r < board.rows; ++r) {
+    line.clear();
+    for (int c = 0; c < board.columns; ++c) {
+      line += board.IsMine(r, c) ? 'X' : '.';
+    }
+    std::cout << line << "\n";
+  }
+  ReplayDecoder decoder(game);
+  Operation op;
+  while (decoder.Next(op)) {
+    std::cout << op.row << " " << op.column << " " << op.type << "\n";
+  }
+  return 0;
+}
+
+/**
+ * Usage:
+ *   replay verify LOG [options]  replay the games of the replay log LOG (see replay.h and `client --batch --record`)
+ *                                on the server alone and check that every one ends with its recorded result; prints
+ *                                the number of games, of mismatches and of operations, and the operations per second.
+ *                                Options: --first-game I (start at game I of the log, found through the index),
+ *                                --games N, --bitboard (replay on BitboardGame)
+ *   replay info LOG              print "game rows columns first_row first_column seed index game_state visit_count
+ *                                marked_count operations operation_bytes" for every game of LOG
+ *   replay show LOG I            print game I of LOG as the input of `server` (the map, then the operations)
+ */
+int main(int argc, char *argv[]) {
+  std::string command = argc > 1 ? argv[1] : "";
+  ReplayReader log;
+  if (command == "verify" && argc >= 3) {
+    int first_game = 0;
+    int games = -1;
+    bool bitboard = false;
+    for (int i = 3; i < argc; ++i) {
+      if (std::strcmp(argv[i], "--first-game") == 0 && i + 1 < argc) {
+        first_game = std::atoi(argv[++i]);
+      } else if (std::strcmp(argv[i], "--games") == 0 && i + 1 < argc) {
+        games = std::atoi(argv[++i]);
+      } else if (std::strcmp(argv[i], "--bitboard") == 0) {
+        bitboard = true;
+      } else {
+        std::cerr << "Unknown option " << argv[i] << std::endl;
+        return 1;
+      }
+    }
+    if (!OpenLog(log, argv[2])) {
+      return 1;
+    }
+    first_game = std::max(first_game, 0);
+    return bitboard ? Verify<BitboardGame>(log, first_game, games) : Verify<MineSweeperGame>(log, first_game, games);
+  } else if (command == "info" && argc == 3) {
+    return OpenLog(log, argv[2]) ? Info(log) : 1;
+  } else if (command == "show" && argc == 4) {
+    return OpenLog(log, argv[2]) ? Show(log, std::atoi(argv[3])) : 1;
+  }
+  std::cerr << "Usage: replay verify LOG [options] | info LOG | show LOG I" << std::endl;
+  return 1;
+}